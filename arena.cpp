@@ -0,0 +1,126 @@
+#include <cstdlib>
+#include "arena.h"
+
+Arena::Arena()
+        : m_block(nullptr), m_pos(nullptr), m_limit(nullptr), m_next_block_size(FIRST_BLOCK_SIZE),
+          m_finalizers(nullptr) {
+}
+
+Arena::~Arena() {
+    run_finalizers();
+    while (m_block != nullptr) {
+        Block *prev = m_block->prev;
+        free(m_block);
+        m_block = prev;
+    }
+}
+
+void Arena::reset() {
+    run_finalizers();
+    if (m_block == nullptr) {
+        return;
+    }
+    // keep the largest block, which is usually the newest, but not
+    // after absorb() has put another arena's blocks behind it
+    Block *largest = m_block;
+    for (Block *b = m_block->prev; b != nullptr; b = b->prev) {
+        if (b->size > largest->size) {
+            largest = b;
+        }
+    }
+    Block *old = m_block;
+    while (old != nullptr) {
+        Block *prev = old->prev;
+        if (old != largest) {
+            free(old);
+        }
+        old = prev;
+    }
+    m_block = largest;
+    m_block->prev = nullptr;
+    m_pos = reinterpret_cast<char *>(m_block + 1);
+    m_limit = m_pos + m_block->size;
+}
+
+void Arena::absorb(Arena &other) {
+    if (other.m_block != nullptr) {
+        if (m_block == nullptr) {
+            // carry on from where the other arena's blocks got to
+            m_block = other.m_block;
+            m_pos = other.m_pos;
+            m_limit = other.m_limit;
+            if (other.m_next_block_size > m_next_block_size) {
+                m_next_block_size = other.m_next_block_size;
+            }
+        } else {
+            // keep allocating from our own newest block; the other
+            // arena's blocks go just behind it
+            Block *oldest = other.m_block;
+            while (oldest->prev != nullptr) {
+                oldest = oldest->prev;
+            }
+            oldest->prev = m_block->prev;
+            m_block->prev = other.m_block;
+        }
+    }
+    if (other.m_finalizers != nullptr) {
+        Finalizer *last = other.m_finalizers;
+        while (last->next != nullptr) {
+            last = last->next;
+        }
+        last->next = m_finalizers;
+        m_finalizers = other.m_finalizers;
+    }
+
+    other.m_block = nullptr;
+    other.m_pos = other.m_limit = nullptr;
+    other.m_finalizers = nullptr;
+}
+
+size_t Arena::get_capacity() const {
+    size_t total = 0;
+    for (Block *b = m_block; b != nullptr; b = b->prev) {
+        total += b->size;
+    }
+    return total;
+}
+
+void *Arena::allocate_slow(size_t size, size_t align) {
+    // leave room to align the start of the object
+    size_t needed = size + align;
+    size_t block_size = m_next_block_size;
+    while (block_size < needed) {
+        block_size *= 2;
+    }
+    if (m_next_block_size < MAX_BLOCK_SIZE) {
+        m_next_block_size *= 2;
+    }
+
+    Block *block = static_cast<Block *>(malloc(sizeof(Block) + block_size));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    block->prev = m_block;
+    block->size = block_size;
+    m_block = block;
+    m_pos = reinterpret_cast<char *>(block + 1);
+    m_limit = m_pos + block_size;
+
+    return reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(m_pos) + align - 1) & ~(align - 1));
+}
+
+void Arena::add_finalizer(void (*fn)(void *), void *obj) {
+    Finalizer *f = static_cast<Finalizer *>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+    f->destroy = fn;
+    f->obj = obj;
+    f->next = m_finalizers;
+    m_finalizers = f;
+}
+
+void Arena::run_finalizers() {
+    while (m_finalizers != nullptr) {
+        Finalizer *f = m_finalizers;
+        m_finalizers = f->next;
+        f->destroy(f->obj);
+    }
+}
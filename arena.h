@@ -0,0 +1,110 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Bump allocator for objects that all die together, such as the nodes
+// of an AST. Memory comes from a list of blocks that grow in size and
+// is only given back when the Arena is reset or destroyed, so there is
+// no per-object bookkeeping. Objects with nontrivial destructors are
+// recorded when they are made, and destroyed (newest first) by reset();
+// everything else is freed without being visited.
+class Arena {
+private:
+    struct Block {
+        Block *prev;
+        size_t size;
+    };
+
+    struct Finalizer {
+        void (*destroy)(void *);
+        void *obj;
+        Finalizer *next;
+    };
+
+    static const size_t FIRST_BLOCK_SIZE = 4096;
+    static const size_t MAX_BLOCK_SIZE = 1024 * 1024;
+
+    Block *m_block;
+    char *m_pos, *m_limit;
+    size_t m_next_block_size;
+    Finalizer *m_finalizers;
+
+    // copy constructor and assignment operator prohibited
+    Arena(const Arena &);
+
+    Arena &operator=(const Arena &);
+
+public:
+    Arena();
+
+    ~Arena();
+
+    // Allocate uninitialized memory.
+    void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        char *p = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(m_pos) + align - 1) & ~(align - 1));
+        if (m_block == nullptr || p + size > m_limit) {
+            p = static_cast<char *>(allocate_slow(size, align));
+        }
+        m_pos = p + size;
+        return p;
+    }
+
+    // Allocate an uninitialized array of a trivially copyable type.
+    template<typename T>
+    T *alloc_array(size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "arena arrays are not constructed");
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // Copy a string into the arena. The copy is NUL-terminated.
+    const char *copy_string(const char *s, size_t len) {
+        char *p = static_cast<char *>(allocate(len + 1, 1));
+        memcpy(p, s, len);
+        p[len] = '\0';
+        return p;
+    }
+
+    // Construct an object in the arena. The arena is passed as the
+    // first constructor argument, so the object can allocate from it
+    // later (e.g. to grow an array).
+    template<typename T, typename... Args>
+    T *make(Args &&... args) {
+        void *mem = allocate(sizeof(T), alignof(T));
+        T *obj = new(mem) T(this, std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            add_finalizer(&destroy<T>, obj);
+        }
+        return obj;
+    }
+
+    // Destroy everything made in the arena and release its memory,
+    // keeping the largest block for reuse.
+    void reset();
+
+    // Take over everything allocated in other, which is left empty.
+    // Objects made in other don't move; they now live as long as this
+    // arena. Lets several threads build parts of one tree, each in an
+    // arena of its own.
+    void absorb(Arena &other);
+
+    // Total bytes of block memory held by the arena.
+    size_t get_capacity() const;
+
+private:
+    void *allocate_slow(size_t size, size_t align);
+
+    void add_finalizer(void (*fn)(void *), void *obj);
+
+    void run_finalizers();
+
+    template<typename T>
+    static void destroy(void *obj) { static_cast<T *>(obj)->~T(); }
+};
+
+#endif // ARENA_H
@@ -1,6 +1,13 @@
+#include <charconv>
 #include "exceptions.h"
 #include "ast.h"
 
+bool int_literal_value(std::string_view text, int &val) {
+    const char *end = text.data() + text.size();
+    std::from_chars_result res = std::from_chars(text.data(), end, val);
+    return res.ec == std::errc() && res.ptr == end;
+}
+
 ASTTreePrint::ASTTreePrint() = default;
 
 ASTTreePrint::~ASTTreePrint() = default;
@@ -59,6 +66,14 @@ std::string ASTTreePrint::node_tag_to_string(int tag) const {
             return "FUNC";
         case AST_ARGLIST:
             return "ARGLIST";
+        case AST_DEFERRED_BODY:
+            return "DEFERRED_BODY";
+        case AST_IMPORT:
+            return "IMPORT";
+        case AST_INLINE_CALL:
+            return "INLINE_CALL";
+        case AST_INVARIANT:
+            return "INVARIANT";
         default:
             RuntimeError::raise("Unknown AST node type %d\n", tag);
     }
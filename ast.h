@@ -1,6 +1,7 @@
 #ifndef AST_H
 #define AST_H
 
+#include <string_view>
 #include "treeprint.h"
 
 // AST node tags
@@ -31,8 +32,16 @@ enum ASTKind {
     AST_STATEMENT_LIST,
     AST_FUNCTION,
     AST_ARGLIST,
+    AST_DEFERRED_BODY,
+    AST_IMPORT,
+    AST_INLINE_CALL,
+    AST_INVARIANT,
 };
 
+// Convert the text of an AST_INT_LITERAL to its value. Returns false if
+// the value doesn't fit in an int.
+bool int_literal_value(std::string_view text, int &val);
+
 class ASTTreePrint : public TreePrint {
 public:
     ASTTreePrint();
@@ -0,0 +1,375 @@
+// Front-end benchmark: generates a synthetic minilang program and times
+// the Lexer on its own, Lexer+Parser2, and freeing the resulting AST.
+//
+// Build with "make bench" (for meaningful numbers, with optimization,
+// e.g. make clean bench CXXFLAGS="-O2 -g -Wall -std=c++17 -pthread").
+//
+// Usage: minilang_bench [options]
+//   -s shape   stmts, funcs, deep, strings, or mixed (default mixed)
+//   -m MB      approximate size of the generated program (default 16)
+//   -d depth   expression nesting depth for the deep shape (default 40)
+//   -r count   number of timed runs; the best is reported (default 3)
+//   -t         lex on a separate thread (Lexer::start_pipeline)
+//   -j         lex in parallel chunks (Lexer::lex_parallel)
+//   -z         defer parsing function bodies (Parser2::set_lazy_functions)
+//   -p         parse function bodies in parallel (Parser2::set_num_threads)
+//   -o file    also write the generated program to file
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "arena.h"
+#include "lexer.h"
+#include "parser2.h"
+#include "node.h"
+#include "exceptions.h"
+
+namespace {
+
+struct Options {
+    std::string shape = "mixed";
+    double megabytes = 16;
+    int depth = 40;
+    int runs = 3;
+    bool pipelined = false;
+    bool parallel = false;
+    bool lazy = false;
+    bool parallel_parse = false;
+    std::string output;
+};
+
+////////////////////////////////////////////////////////////////////////
+// Program generator
+////////////////////////////////////////////////////////////////////////
+
+class Generator {
+private:
+    std::string m_out;
+    unsigned m_seed;
+    int m_num_vars;
+    int m_num_funcs;
+
+public:
+    Generator() : m_seed(12345), m_num_vars(0), m_num_funcs(0) {}
+
+    std::string generate(const std::string &shape, size_t size, int depth);
+
+private:
+    // deterministic pseudo-random numbers, so runs are comparable
+    unsigned rand(unsigned bound) {
+        m_seed = m_seed * 1103515245u + 12345u;
+        return (m_seed >> 8) % bound;
+    }
+
+    std::string var() { return "v" + std::to_string(rand(unsigned(m_num_vars))); }
+
+    void emit_vars(int count);
+
+    void emit_expr(int depth);
+
+    void emit_stmt(int indent);
+
+    void emit_stmt_list();
+
+    void emit_function();
+
+    void emit_deep(int depth);
+
+    void emit_string();
+};
+
+std::string Generator::generate(const std::string &shape, size_t size, int depth) {
+    m_out.reserve(size + 4096);
+    emit_vars(100);
+    int which = 0;
+    while (m_out.size() < size) {
+        std::string s = shape;
+        if (s == "mixed") {
+            const char *shapes[] = {"stmts", "funcs", "deep", "strings"};
+            s = shapes[which++ % 4];
+        }
+        if (s == "stmts") {
+            emit_stmt_list();
+        } else if (s == "funcs") {
+            emit_function();
+        } else if (s == "deep") {
+            emit_deep(depth);
+        } else if (s == "strings") {
+            emit_string();
+        } else {
+            RuntimeError::raise("Unknown shape '%s'", shape.c_str());
+        }
+    }
+    return m_out;
+}
+
+void Generator::emit_vars(int count) {
+    for (int i = 0; i < count; i++) {
+        m_out += "var v" + std::to_string(m_num_vars++) + ";\n";
+    }
+}
+
+void Generator::emit_expr(int depth) {
+    if (depth == 0 || rand(3) == 0) {
+        if (rand(2) == 0) {
+            m_out += var();
+        } else {
+            m_out += std::to_string(rand(1000));
+        }
+        return;
+    }
+    const char *ops[] = {" + ", " - ", " * ", " / "};
+    m_out += "(";
+    emit_expr(depth - 1);
+    m_out += ops[rand(4)];
+    emit_expr(depth - 1);
+    m_out += ")";
+}
+
+void Generator::emit_stmt(int indent) {
+    m_out.append(size_t(indent), ' ');
+    switch (rand(6)) {
+        case 0:
+            m_out += "if (" + var() + " < " + std::to_string(rand(100)) + ") {\n";
+            emit_stmt(indent + 2);
+            m_out.append(size_t(indent), ' ');
+            m_out += "} else {\n";
+            emit_stmt(indent + 2);
+            m_out.append(size_t(indent), ' ');
+            m_out += "}\n";
+            break;
+        case 1:
+            m_out += "while (" + var() + " > 0) {\n";
+            emit_stmt(indent + 2);
+            m_out.append(size_t(indent), ' ');
+            m_out += "}\n";
+            break;
+        case 2:
+            if (m_num_funcs > 0) {
+                m_out += var() + " = f" + std::to_string(rand(unsigned(m_num_funcs))) + "(" + var() + ", " +
+                         var() + ");\n";
+                break;
+            }
+            // fall through
+        default:
+            m_out += var() + " = ";
+            emit_expr(3);
+            m_out += ";\n";
+            break;
+    }
+}
+
+void Generator::emit_stmt_list() {
+    for (int i = 0; i < 50; i++) {
+        emit_stmt(0);
+    }
+}
+
+void Generator::emit_function() {
+    m_out += "function f" + std::to_string(m_num_funcs++) + "(a, b) {\n  var t;\n";
+    for (int i = 0, n = 2 + int(rand(8)); i < n; i++) {
+        m_out += "  t = ";
+        emit_expr(2);
+        m_out += " + a * b;\n";
+    }
+    m_out += "  t;\n}\n";
+}
+
+void Generator::emit_deep(int depth) {
+    m_out += var() + " = ";
+    for (int i = 0; i < depth; i++) {
+        m_out += "(";
+    }
+    m_out += var();
+    const char *ops[] = {" + ", " - ", " * ", " < ", " == ", " && "};
+    for (int i = 0; i < depth; i++) {
+        m_out += ops[rand(6)] + std::to_string(rand(100)) + ")";
+    }
+    m_out += ";\n";
+}
+
+void Generator::emit_string() {
+    m_out += "println(\"";
+    for (int i = 0, n = 200 + int(rand(2000)); i < n; i++) {
+        switch (rand(40)) {
+            case 0:
+                m_out += "\\n";
+                break;
+            case 1:
+                m_out += "\\\"";
+                break;
+            case 2:
+                m_out += ' ';
+                break;
+            default:
+                m_out += char('a' + rand(26));
+                break;
+        }
+    }
+    m_out += "\");\n";
+}
+
+////////////////////////////////////////////////////////////////////////
+// Timing
+////////////////////////////////////////////////////////////////////////
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+Lexer *open_lexer(const char *path, const Options &opts) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        RuntimeError::raise("Could not open '%s'", path);
+    }
+    Lexer *lexer = new Lexer(in, path);
+    if (opts.parallel) {
+        lexer->lex_parallel(int(std::thread::hardware_concurrency()));
+    } else if (opts.pipelined) {
+        lexer->start_pipeline();
+    }
+    return lexer;
+}
+
+double peak_rss_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // ru_maxrss is in kilobytes on Linux
+    return double(usage.ru_maxrss) / 1024.0;
+}
+
+void report(const char *what, double secs, double megabytes, double tokens) {
+    printf("%-12s %9.4f s %10.1f MB/s %10.2f M tokens/s\n", what, secs, megabytes / secs, tokens / secs / 1e6);
+}
+
+void run(const Options &opts) {
+    Generator gen;
+    std::string program = gen.generate(opts.shape, size_t(opts.megabytes * 1024 * 1024), opts.depth);
+    double megabytes = double(program.size()) / (1024.0 * 1024.0);
+
+    std::string path = opts.output;
+    if (path.empty()) {
+        char tmpl[] = "/tmp/minilang_bench_XXXXXX";
+        int fd = mkstemp(tmpl);
+        if (fd < 0) {
+            RuntimeError::raise("Could not create temporary file");
+        }
+        close(fd);
+        path = tmpl;
+    }
+    FILE *out = fopen(path.c_str(), "w");
+    if (!out || fwrite(program.data(), 1, program.size(), out) != program.size()) {
+        RuntimeError::raise("Could not write '%s'", path.c_str());
+    }
+    fclose(out);
+    program.clear();
+    program.shrink_to_fit();
+
+    double best_lex = 1e30, best_parse = 1e30, best_delete = 1e30;
+    double tokens = 0;
+    for (int r = 0; r < opts.runs; r++) {
+        // Lexer alone (the -l path, without printing)
+        Clock::time_point start = Clock::now();
+        std::unique_ptr<Lexer> lexer(open_lexer(path.c_str(), opts));
+        long count = 0;
+        while (lexer->peek() != nullptr) {
+            lexer->next();
+            count++;
+        }
+        lexer.reset();
+        best_lex = std::min(best_lex, seconds_since(start));
+        tokens = double(count);
+
+        // Lexer + Parser2
+        start = Clock::now();
+        std::unique_ptr<Arena> arena(new Arena);
+        std::unique_ptr<Parser2> parser(new Parser2(open_lexer(path.c_str(), opts), arena.get()));
+        parser->set_lazy_functions(opts.lazy);
+        if (opts.parallel_parse) {
+            parser->set_num_threads(int(std::thread::hardware_concurrency()));
+        }
+        parser->parse();
+        best_parse = std::min(best_parse, seconds_since(start));
+        parser.reset();
+
+        // AST destruction
+        start = Clock::now();
+        arena.reset();
+        best_delete = std::min(best_delete, seconds_since(start));
+    }
+
+    if (opts.output.empty()) {
+        unlink(path.c_str());
+    }
+
+    printf("shape=%s size=%.2f MB tokens=%.0f runs=%d%s%s%s\n", opts.shape.c_str(), megabytes, tokens, opts.runs,
+           opts.parallel ? " (parallel lexing)" : opts.pipelined ? " (pipelined lexing)" : "",
+           opts.lazy ? " (lazy function bodies)" : "", opts.parallel_parse ? " (parallel function parsing)" : "");
+    report("lex", best_lex, megabytes, tokens);
+    report("lex+parse", best_parse, megabytes, tokens);
+    report("ast free", best_delete, megabytes, tokens);
+    printf("peak RSS     %9.1f MB\n", peak_rss_mb());
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opts;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:m:d:r:tjzpo:")) != -1) {
+        switch (opt) {
+            case 's':
+                opts.shape = optarg;
+                break;
+            case 'm':
+                opts.megabytes = atof(optarg);
+                break;
+            case 'd':
+                opts.depth = atoi(optarg);
+                break;
+            case 'r':
+                opts.runs = atoi(optarg) > 0 ? atoi(optarg) : 1;
+                break;
+            case 't':
+                opts.pipelined = true;
+                break;
+            case 'j':
+                opts.parallel = true;
+                break;
+            case 'z':
+                opts.lazy = true;
+                break;
+            case 'p':
+                opts.parallel_parse = true;
+                break;
+            case 'o':
+                opts.output = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s shape] [-m MB] [-d depth] [-r runs] [-t] [-j] [-z] [-p] [-o file]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    try {
+        run(opts);
+    } catch (BaseException &ex) {
+        if (ex.has_location()) {
+            const Location &loc = ex.get_loc();
+            fprintf(stderr, "%s:%d:%d: Error: %s\n", loc.get_srcfile().c_str(), loc.get_line(), loc.get_col(),
+                    ex.what());
+        } else {
+            fprintf(stderr, "Error: %s\n", ex.what());
+        }
+        return 1;
+    }
+    return 0;
+}
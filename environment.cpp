@@ -1,8 +1,8 @@
 #include "environment.h"
 #include "exceptions.h"
 
-Environment::Environment(Environment *parent)
-        : m_parent(parent) {
+Environment::Environment(Environment *parent, unsigned num_slots)
+        : m_parent(parent), m_slots(num_slots) {
     assert(m_parent != this);
 }
 
@@ -10,45 +10,36 @@ Environment::~Environment() = default;
 
 
 // Add new variable to environment
-void Environment::new_variable(const std::string &identifier, const Location &loc, const ValueKind kind) {
-    if (Environment::variables.find(identifier) != Environment::variables.end()) {
-        SemanticError::raise(loc, "Variable %s already exists", identifier.c_str());
+void Environment::new_variable(Symbol identifier, const Location &loc, const ValueKind kind) {
+    if (is_defined(identifier)) {
+        SemanticError::raise(loc, "Variable %s already exists", symtab::get_name(identifier).c_str());
     }
-    Value val = kind;
-    Environment::variables.insert({identifier, val});
+    if (unsigned(identifier) >= m_slots.size()) {
+        m_slots.resize(unsigned(identifier) + 1);
+        m_defined.resize(unsigned(identifier) + 1);
+    }
+    m_slots[unsigned(identifier)] = kind;
+    m_defined[unsigned(identifier)] = true;
 }
 
 // set value of variable in environment
-void Environment::set_variable(const std::string &identifier, const Value &value, const Location &loc) {
-    if (Environment::variables.find(identifier) == Environment::variables.end()) {
-        if (m_parent == nullptr) {
-            // we are in global environment
-            SemanticError::raise(loc, "Tried to access variable %s, not found", identifier.c_str());
-
-        }
-        m_parent->set_variable(identifier, value, loc);
-        return;
+void Environment::set_variable(Symbol identifier, const Value &value, const Location &loc) {
+    if (!is_defined(identifier)) {
+        SemanticError::raise(loc, "Tried to access variable %s, not found", symtab::get_name(identifier).c_str());
     }
-
-    Environment::variables.erase(Environment::variables.find(identifier));
-    Environment::variables.insert({identifier, value});
+    m_slots[unsigned(identifier)] = value;
 }
 
 
 // Get value of variable from environment
-Value Environment::get_variable(const std::string &identifier, const Location &loc) {
-
-    if (Environment::variables.find(identifier) == Environment::variables.end()) {
-        if (m_parent == nullptr) {
-            // we are in global environment
-            SemanticError::raise(loc, "Tried to access variable %s, not found", identifier.c_str());
-        }
-        return m_parent->get_variable(identifier, loc);
+const Value &Environment::get_variable(Symbol identifier, const Location &loc) {
+    if (!is_defined(identifier)) {
+        SemanticError::raise(loc, "Tried to access variable %s, not found", symtab::get_name(identifier).c_str());
     }
-    return Environment::variables[identifier];
+    return m_slots[unsigned(identifier)];
 }
 
-void Environment::bind(const std::string &identifier, const Location &loc, const Value &value) {
+void Environment::bind(Symbol identifier, const Location &loc, const Value &value) {
     new_variable(identifier, loc, value.get_kind());
     set_variable(identifier, value, loc);
 }
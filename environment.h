@@ -2,15 +2,21 @@
 #define ENVIRONMENT_H
 
 #include <cassert>
-#include <map>
-#include <string>
+#include <vector>
 #include "value.h"
+#include "symtab.h"
 #include "node.h"
 
+// A frame of variables. Local variables are kept in numbered slots
+// (numbered by ScopeResolver), so a frame is just an array. The global
+// frame, which has no parent, is indexed by Symbol instead, and grows
+// as variables are defined.
 class Environment {
 private:
     Environment *m_parent;
-    std::map<std::string, Value> variables;
+    std::vector<Value> m_slots;
+    // global frame only: which Symbols name a variable
+    std::vector<bool> m_defined;
 
     // copy constructor and assignment operator prohibited
     Environment(const Environment &);
@@ -18,17 +24,37 @@ private:
     Environment &operator=(const Environment &);
 
 public:
-    explicit Environment(Environment *parent = nullptr);
+    explicit Environment(Environment *parent = nullptr, unsigned num_slots = 0);
 
     ~Environment();
 
-    Value get_variable(const std::string &identifier, const Location &loc);
+    // Get the frame depth levels out from this one.
+    Environment *get_frame(int depth) {
+        Environment *env = this;
+        for (; depth > 0; depth--) {
+            env = env->m_parent;
+        }
+        return env;
+    }
 
-    void set_variable(const std::string &identifier, const Value &value, const Location &loc);
+    Value &get_slot(int slot) {
+        assert(unsigned(slot) < m_slots.size());
+        return m_slots[unsigned(slot)];
+    }
 
-    void bind(const std::string &identifier, const Location &loc, const Value &value);
+    // Global variables, by name
+    const Value &get_variable(Symbol identifier, const Location &loc);
 
-    void new_variable(const std::string &identifier, const Location &loc, ValueKind kind);
+    void set_variable(Symbol identifier, const Value &value, const Location &loc);
+
+    void bind(Symbol identifier, const Location &loc, const Value &value);
+
+    void new_variable(Symbol identifier, const Location &loc, ValueKind kind);
+
+private:
+    bool is_defined(Symbol identifier) const {
+        return unsigned(identifier) < m_defined.size() && m_defined[unsigned(identifier)];
+    }
 };
 
 #endif // ENVIRONMENT_H
@@ -0,0 +1,447 @@
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include "node.h"
+#include "flat_ast.h"
+
+FlatAST::FlatAST(Node *root) {
+    // operator and keyword strings repeat a lot, so store each once
+    std::unordered_map<std::string, int32_t> string_index;
+    auto add_string = [&](std::string_view str) {
+        auto i = string_index.insert({std::string(str), int32_t(m_strings.size())});
+        if (i.second) {
+            m_strings.emplace_back(str);
+        }
+        return i.first->second;
+    };
+
+    // Nodes are placed depth-first, reserving a block for the kids
+    // of each node as it is visited, so a subtree mostly occupies
+    // a contiguous range. An explicit stack keeps deep trees from
+    // overflowing the C++ stack.
+    std::vector<std::pair<Node *, uint32_t>> stack;
+    size_t count = 0;
+    for (std::vector<Node *> pending(1, root); !pending.empty(); count++) {
+        Node *n = pending.back();
+        pending.pop_back();
+        pending.insert(pending.end(), n->cbegin(), n->cend());
+    }
+    m_nodes.reserve(count);
+    m_locs.reserve(count);
+    m_scopes.reserve(count);
+
+    m_nodes.resize(1);
+    m_locs.resize(1);
+    m_scopes.resize(1);
+    stack.push_back({root, 0});
+    while (!stack.empty()) {
+        Node *n = stack.back().first;
+        uint32_t index = stack.back().second;
+        stack.pop_back();
+        assert(n->get_tag() != AST_DEFERRED_BODY);
+
+        FlatNode flat;
+        flat.tag = n->get_tag();
+        flat.first_kid = uint32_t(m_nodes.size());
+        flat.num_kids = n->get_num_kids();
+        if (flat.tag == AST_VARREF) {
+            flat.payload = n->get_sym();
+        } else if (flat.tag == AST_INT_LITERAL) {
+            // one too large for an int is only an error if it's evaluated
+            FlatIntLiteral lit;
+            lit.text = add_string(n->get_str());
+            lit.has_value = n->has_int_value();
+            lit.value = lit.has_value ? n->get_int_value() : 0;
+            if (!lit.has_value) {
+                lit.has_value = int_literal_value(n->get_str(), lit.value);
+            }
+            flat.payload = int32_t(m_ints.size());
+            m_ints.push_back(lit);
+        } else {
+            std::string_view str = n->get_str();
+            flat.payload = str.empty() ? -1 : add_string(str);
+        }
+        m_nodes[index] = flat;
+        m_locs[index] = n->get_loc();
+        m_scopes[index] = n->get_scope();
+
+        m_nodes.resize(m_nodes.size() + flat.num_kids);
+        m_locs.resize(m_locs.size() + flat.num_kids);
+        m_scopes.resize(m_scopes.size() + flat.num_kids);
+        // push in reverse so the first kid is laid out first
+        for (unsigned i = flat.num_kids; i > 0; i--) {
+            stack.push_back({n->get_kid(i - 1), flat.first_kid + i - 1});
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Binary images
+////////////////////////////////////////////////////////////////////////
+
+// An image is a sequence of tables, each a count followed by the
+// entries: file names, symbol names, strings, integers, and nodes.
+// All numbers are LEB128 varints (signed ones zigzag encoded) and
+// strings are a length and the characters, so an image is typically
+// a quarter of the size of the arrays themselves. An integer is the
+// index of its text in the string table times two plus whether it has
+// a value, then the value. For each node the
+// image has its tag, number of kids, the distance to its first kid,
+// payload + 1 (the payload of an AST_VARREF being an index into the
+// image's symbol table), its Location as a file index and the
+// change in line and column from the previous node, and for an
+// AST_VARREF or AST_STATEMENT_LIST, its ScopeInfo (for an AST_VARREF,
+// the depth times two plus always_int, and the slot).
+
+namespace {
+
+void put_varint(std::string &out, uint64_t val) {
+    while (val >= 0x80) {
+        out += char(val | 0x80);
+        val >>= 7;
+    }
+    out += char(val);
+}
+
+void put_signed(std::string &out, int64_t val) {
+    put_varint(out, (uint64_t(val) << 1) ^ uint64_t(val >> 63));
+}
+
+void put_str(std::string &out, const std::string &s) {
+    put_varint(out, s.size());
+    out += s;
+}
+
+// Reads an image, checking every read against the end of the data.
+class ImageReader {
+private:
+    const uint8_t *m_pos, *m_end;
+
+public:
+    ImageReader(const char *data, size_t size)
+            : m_pos(reinterpret_cast<const uint8_t *>(data)), m_end(m_pos + size) {}
+
+    bool get_varint(uint64_t &val) {
+        val = 0;
+        for (unsigned shift = 0; m_pos != m_end && shift < 64; shift += 7) {
+            uint8_t b = *m_pos++;
+            val |= uint64_t(b & 0x7F) << shift;
+            if (b < 0x80) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool get_u32(uint32_t &val) {
+        uint64_t v;
+        if (!get_varint(v) || v > UINT32_MAX) {
+            return false;
+        }
+        val = uint32_t(v);
+        return true;
+    }
+
+    bool get_int(int32_t &val) {
+        uint64_t v;
+        if (!get_varint(v)) {
+            return false;
+        }
+        int64_t s = int64_t(v >> 1) ^ -int64_t(v & 1);
+        if (s < INT32_MIN || s > INT32_MAX) {
+            return false;
+        }
+        val = int32_t(s);
+        return true;
+    }
+
+    bool get_str(std::string &s) {
+        uint32_t len;
+        if (!get_u32(len) || len > size_t(m_end - m_pos)) {
+            return false;
+        }
+        s.assign(reinterpret_cast<const char *>(m_pos), len);
+        m_pos += len;
+        return true;
+    }
+
+    // Read a count of entries, each at least min_size bytes long.
+    bool get_count(uint32_t &count, size_t min_size) {
+        return get_u32(count) && count <= size_t(m_end - m_pos) / min_size;
+    }
+
+    bool at_end() const { return m_pos == m_end; }
+};
+
+}
+
+void FlatAST::write_image(std::string &out, FileId main_file) const {
+    std::unordered_map<FileId, uint32_t> file_index;
+    std::vector<FileId> files;
+    for (const Location &loc : m_locs) {
+        if (file_index.insert({loc.get_file(), uint32_t(files.size())}).second) {
+            files.push_back(loc.get_file());
+        }
+    }
+    std::unordered_map<Symbol, uint32_t> symbol_index;
+    std::vector<Symbol> symbols;
+    for (const FlatNode &node : m_nodes) {
+        if (node.tag == AST_VARREF && symbol_index.insert({node.payload, uint32_t(symbols.size())}).second) {
+            symbols.push_back(node.payload);
+        }
+    }
+
+    put_varint(out, files.size());
+    for (FileId file : files) {
+        // the empty name stands for main_file
+        put_str(out, file == main_file ? std::string() : Location::get_file_name(file));
+    }
+    put_varint(out, symbols.size());
+    for (Symbol sym : symbols) {
+        put_str(out, symtab::get_name(sym));
+    }
+    put_varint(out, m_strings.size());
+    for (const std::string &s : m_strings) {
+        put_str(out, s);
+    }
+    put_varint(out, m_ints.size());
+    for (const FlatIntLiteral &lit : m_ints) {
+        put_varint(out, uint64_t(lit.text) << 1 | uint64_t(lit.has_value));
+        put_signed(out, lit.value);
+    }
+
+    put_varint(out, m_nodes.size());
+    int line = 0, col = 0;
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+        const FlatNode &node = m_nodes[i];
+        const Location &loc = m_locs[i];
+        put_signed(out, node.tag);
+        put_varint(out, node.num_kids);
+        if (node.num_kids > 0) {
+            put_varint(out, node.first_kid - i);
+        }
+        int64_t payload = node.tag == AST_VARREF ? int64_t(symbol_index[node.payload]) : int64_t(node.payload);
+        put_varint(out, uint64_t(payload + 1));
+        put_varint(out, file_index[loc.get_file()]);
+        put_signed(out, int64_t(loc.get_line()) - line);
+        put_signed(out, int64_t(loc.get_col()) - col);
+        line = loc.get_line();
+        col = loc.get_col();
+        const ScopeInfo &scope = m_scopes[i];
+        if (node.tag == AST_VARREF) {
+            put_varint(out, uint64_t(scope.depth) << 1 | uint64_t(scope.always_int));
+            put_signed(out, scope.slot);
+        } else if (node.tag == AST_INLINE_CALL || node.tag == AST_INVARIANT) {
+            put_signed(out, scope.slot);
+        } else if (node.tag == AST_WHILE) {
+            put_signed(out, scope.slot);
+            put_signed(out, scope.num_slots);
+        } else if (node.tag == AST_STATEMENT_LIST) {
+            put_signed(out, scope.num_slots);
+        }
+    }
+}
+
+FlatAST *FlatAST::read_image(const char *data, size_t size, FileId main_file) {
+    ImageReader in(data, size);
+    std::unique_ptr<FlatAST> ast(new FlatAST);
+    uint32_t count;
+    std::string s;
+
+    std::vector<FileId> files;
+    if (!in.get_count(count, 1)) {
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (!in.get_str(s)) {
+            return nullptr;
+        }
+        files.push_back(s.empty() ? main_file : Location::register_file(s));
+    }
+
+    std::vector<Symbol> symbols;
+    if (!in.get_count(count, 1)) {
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (!in.get_str(s)) {
+            return nullptr;
+        }
+        symbols.push_back(symtab::intern(s));
+    }
+
+    if (!in.get_count(count, 1)) {
+        return nullptr;
+    }
+    ast->m_strings.resize(count);
+    for (std::string &str : ast->m_strings) {
+        if (!in.get_str(str)) {
+            return nullptr;
+        }
+    }
+
+    if (!in.get_count(count, 1)) {
+        return nullptr;
+    }
+    ast->m_ints.resize(count);
+    for (FlatIntLiteral &lit : ast->m_ints) {
+        uint64_t text;
+        if (!in.get_varint(text) || (text >> 1) >= ast->m_strings.size() || !in.get_int(lit.value)) {
+            return nullptr;
+        }
+        lit.text = int32_t(text >> 1);
+        lit.has_value = (text & 1) != 0;
+    }
+
+    // a node takes at least 6 bytes
+    if (!in.get_count(count, 6) || count == 0) {
+        return nullptr;
+    }
+    ast->m_nodes.resize(count);
+    ast->m_locs.reserve(count);
+    ast->m_scopes.resize(count);
+    int32_t line = 0, col = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        FlatNode &node = ast->m_nodes[i];
+        uint32_t kid_offset = 0, payload, file;
+        int32_t line_delta, col_delta;
+        if (!in.get_int(node.tag) || !in.get_u32(node.num_kids) ||
+            (node.num_kids > 0 && !in.get_u32(kid_offset)) || !in.get_u32(payload) || !in.get_u32(file) ||
+            !in.get_int(line_delta) || !in.get_int(col_delta)) {
+            return nullptr;
+        }
+
+        // Kids always come after their parent, which rules out cycles,
+        // so a damaged image can't send the interpreter into a loop.
+        node.first_kid = uint32_t(i + kid_offset);
+        if (node.num_kids > 0 && (kid_offset == 0 || uint64_t(i) + kid_offset + node.num_kids > count)) {
+            return nullptr;
+        }
+        node.payload = int32_t(payload - 1);
+        if (node.tag == AST_VARREF) {
+            if (payload == 0 || payload > symbols.size()) {
+                return nullptr;
+            }
+            node.payload = symbols[payload - 1];
+        } else if (node.tag == AST_INT_LITERAL) {
+            if (payload == 0 || payload > ast->m_ints.size()) {
+                return nullptr;
+            }
+        } else if (payload > ast->m_strings.size()) {
+            return nullptr;
+        }
+
+        if (file >= files.size()) {
+            return nullptr;
+        }
+        line += line_delta;
+        col += col_delta;
+        ast->m_locs.push_back(Location(files[file], line, col));
+
+        ScopeInfo &scope = ast->m_scopes[i];
+        uint32_t depth = 0;
+        if (node.tag == AST_VARREF && (!in.get_u32(depth) || !in.get_int(scope.slot))) {
+            return nullptr;
+        }
+        scope.depth = int(depth >> 1);
+        scope.always_int = (depth & 1) != 0;
+        if ((node.tag == AST_INLINE_CALL || node.tag == AST_INVARIANT) && !in.get_int(scope.slot)) {
+            return nullptr;
+        }
+        if (node.tag == AST_WHILE && (!in.get_int(scope.slot) || !in.get_int(scope.num_slots))) {
+            return nullptr;
+        }
+        if (node.tag == AST_STATEMENT_LIST && !in.get_int(scope.num_slots)) {
+            return nullptr;
+        }
+    }
+    if (!in.at_end() || !ast->check_scopes()) {
+        return nullptr;
+    }
+
+    return ast.release();
+}
+
+// Check that every variable of a program read from an image is in a
+// frame the interpreter will have made, so a damaged image can't make
+// it read or write outside one.
+bool FlatAST::check_scopes() const {
+    // a node to check, the number of frames out to the global frame,
+    // and the number of slots in the innermost one
+    struct Pending {
+        uint32_t index;
+        int level, num_slots;
+    };
+    std::vector<Pending> pending(1, Pending{0, 0, 0});
+    while (!pending.empty()) {
+        Pending p = pending.back();
+        pending.pop_back();
+        const FlatNode &node = m_nodes[p.index];
+        const ScopeInfo &scope = m_scopes[p.index];
+
+        if (node.tag == AST_VARREF) {
+            bool ok;
+            switch (scope.slot) {
+                case ScopeInfo::GLOBAL:
+                    ok = scope.depth == p.level && !scope.always_int;
+                    break;
+                case ScopeInfo::REDECLARED:
+                    ok = p.level > 0 && !scope.always_int;
+                    break;
+                default:
+                    // locals are always in the innermost frame
+                    ok = scope.depth == 0 && p.level > 0 && scope.slot >= 0 && scope.slot < p.num_slots;
+                    break;
+            }
+            if (!ok) {
+                return false;
+            }
+        } else if (node.tag == AST_INLINE_CALL) {
+            // the arguments go in the slots from scope.slot on, and the
+            // last kid is the body
+            if (p.level == 0 || node.num_kids == 0 || scope.slot < 0 ||
+                int64_t(scope.slot) + node.num_kids - 1 > p.num_slots) {
+                return false;
+            }
+        } else if (node.tag == AST_INVARIANT) {
+            if (p.level == 0 || node.num_kids != 1 || scope.slot < 0 || int64_t(scope.slot) + 2 > p.num_slots) {
+                return false;
+            }
+        } else if (node.tag == AST_WHILE && scope.num_slots > 0) {
+            // the slots of the loop's invariants are in the frame its
+            // body runs in, which at the top level is the body's own
+            int frame_slots = p.num_slots;
+            if (p.level == 0) {
+                frame_slots = -1;
+                if (node.num_kids == 2 && m_nodes[node.first_kid + 1].tag == AST_STATEMENT_LIST) {
+                    frame_slots = m_scopes[node.first_kid + 1].num_slots;
+                }
+            }
+            if (scope.slot < 0 || int64_t(scope.slot) + scope.num_slots > frame_slots) {
+                return false;
+            }
+        }
+
+        for (uint32_t i = 0; i < node.num_kids; i++) {
+            uint32_t kid = node.first_kid + i;
+            const ScopeInfo &kid_scope = m_scopes[kid];
+            if (m_nodes[kid].tag == AST_STATEMENT_LIST && kid_scope.num_slots >= 0) {
+                // a function body or top-level block, which starts a
+                // frame; a function's parameters take its first slots
+                if (p.level > 0 || (node.tag == AST_FUNCTION && (i != 2 ||
+                        kid_scope.num_slots < int(m_nodes[node.first_kid + 1].num_kids)))) {
+                    return false;
+                }
+                pending.push_back(Pending{kid, 1, kid_scope.num_slots});
+            } else if (node.tag == AST_FUNCTION && i == 2) {
+                // a function body always starts a frame
+                return false;
+            } else if (m_nodes[kid].tag != AST_PARAMETER_LIST) {
+                // (parameters are bound by position, not through their
+                // nodes)
+                pending.push_back(Pending{kid, p.level, p.num_slots});
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,170 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "location.h"
+#include "symtab.h"
+#include "ast.h"
+#include "node_base.h"
+
+class Node;
+
+class FlatAST;
+
+// One node of a FlatAST. The kids of a node are stored next to each
+// other, starting at first_kid. What payload means depends on the tag:
+// the Symbol of an AST_VARREF, an index into the integer table for an
+// AST_INT_LITERAL, and otherwise an index into the string table (or -1
+// if the node has no string).
+struct FlatNode {
+    int32_t tag;
+    uint32_t first_kid;
+    uint32_t num_kids;
+    int32_t payload;
+};
+
+// An entry of the integer table of a FlatAST: the text of an int
+// literal, as written (an index into the string table), and its value,
+// if that fits in an int.
+struct FlatIntLiteral {
+    int32_t text;
+    bool has_value;
+    int value;
+};
+
+// Handle for a node in a FlatAST. It has the same accessors as Node,
+// and operator-> returns the handle itself, so code written for a
+// Node * (e.g. the interpreter and TreePrint) can walk a FlatAST
+// unchanged.
+class FlatNodeRef {
+private:
+    const FlatAST *m_ast;
+    uint32_t m_index;
+
+public:
+    FlatNodeRef() : m_ast(nullptr), m_index(0) {}
+
+    FlatNodeRef(const FlatAST *ast, uint32_t index) : m_ast(ast), m_index(index) {}
+
+    const FlatNodeRef *operator->() const { return this; }
+
+    uint32_t get_index() const { return m_index; }
+
+    inline int get_tag() const;
+
+    inline unsigned get_num_kids() const;
+
+    inline FlatNodeRef get_kid(unsigned index) const;
+
+    FlatNodeRef get_last_kid() const { return get_kid(get_num_kids() - 1); }
+
+    inline std::string_view get_str() const;
+
+    inline Symbol get_sym() const;
+
+    // value of an AST_INT_LITERAL, if it fits in an int
+    inline bool has_int_value() const;
+
+    inline int get_int_value() const;
+
+    inline const Location &get_loc() const;
+
+    inline const ScopeInfo &get_scope() const;
+};
+
+// An AST stored in a few contiguous arrays rather than as separately
+// allocated Nodes: a node is 16 bytes, and walking the tree touches
+// far less memory. Built from a Node tree, which can be freed
+// afterwards. Function bodies must already have been parsed.
+class FlatAST {
+private:
+    std::vector<FlatNode> m_nodes;
+    std::vector<Location> m_locs;     // indexed like m_nodes
+    std::vector<ScopeInfo> m_scopes; // indexed like m_nodes
+    std::vector<std::string> m_strings;
+    std::vector<FlatIntLiteral> m_ints;
+
+    // copy constructor and assignment operator prohibited
+    FlatAST(const FlatAST &);
+
+    FlatAST &operator=(const FlatAST &);
+
+    FlatAST() {}
+
+    bool check_scopes() const;
+
+    friend class FlatNodeRef;
+
+public:
+    explicit FlatAST(Node *root);
+
+    // Append a self-contained binary image of the tree to out, for
+    // read_image() to load in another process. Symbols and file names
+    // are stored by name; main_file is stored as "the file being run",
+    // so the image doesn't depend on the path it was compiled from.
+    void write_image(std::string &out, FileId main_file) const;
+
+    // Load an image written by write_image(), with main_file taking
+    // the place of the file it was compiled from. Returns nullptr if
+    // the image is truncated or inconsistent.
+    static FlatAST *read_image(const char *data, size_t size, FileId main_file);
+
+    FlatNodeRef get_root() const { return FlatNodeRef(this, 0); }
+
+    size_t get_num_nodes() const { return m_nodes.size(); }
+};
+
+int FlatNodeRef::get_tag() const {
+    return m_ast->m_nodes[m_index].tag;
+}
+
+unsigned FlatNodeRef::get_num_kids() const {
+    return m_ast->m_nodes[m_index].num_kids;
+}
+
+FlatNodeRef FlatNodeRef::get_kid(unsigned index) const {
+    const FlatNode &node = m_ast->m_nodes[m_index];
+    assert(index < node.num_kids);
+    return FlatNodeRef(m_ast, node.first_kid + index);
+}
+
+Symbol FlatNodeRef::get_sym() const {
+    const FlatNode &node = m_ast->m_nodes[m_index];
+    return node.tag == AST_VARREF ? node.payload : NO_SYMBOL;
+}
+
+std::string_view FlatNodeRef::get_str() const {
+    const FlatNode &node = m_ast->m_nodes[m_index];
+    switch (node.tag) {
+        case AST_VARREF:
+            return symtab::get_name(node.payload);
+        case AST_INT_LITERAL:
+            return m_ast->m_strings[size_t(m_ast->m_ints[size_t(node.payload)].text)];
+        default:
+            return node.payload < 0 ? std::string_view() : m_ast->m_strings[size_t(node.payload)];
+    }
+}
+
+bool FlatNodeRef::has_int_value() const {
+    const FlatNode &node = m_ast->m_nodes[m_index];
+    return node.tag == AST_INT_LITERAL && m_ast->m_ints[size_t(node.payload)].has_value;
+}
+
+int FlatNodeRef::get_int_value() const {
+    assert(has_int_value());
+    return m_ast->m_ints[size_t(m_ast->m_nodes[m_index].payload)].value;
+}
+
+const Location &FlatNodeRef::get_loc() const {
+    return m_ast->m_locs[m_index];
+}
+
+const ScopeInfo &FlatNodeRef::get_scope() const {
+    return m_ast->m_scopes[m_index];
+}
+
+#endif // FLAT_AST_H
@@ -1,8 +1,28 @@
 #include "function.h"
 
-Function::Function(const std::string &name, const std::vector<std::string> &params, Environment *parent_env, Node *body)
+Function::Function(const std::string &name, const std::vector<Symbol> &params, Environment *parent_env, Node *body)
         : ValRep(VALREP_FUNCTION), m_name(name), m_params(params), m_parent_env(parent_env), m_body(body) {
+  find_repeated_param();
+}
+
+Function::Function(const std::string &name, const std::vector<Symbol> &params, Environment *parent_env,
+                   FlatNodeRef body)
+        : ValRep(VALREP_FUNCTION), m_name(name), m_params(params), m_parent_env(parent_env), m_body(nullptr),
+          m_flat_body(body) {
+  find_repeated_param();
 }
 
 Function::~Function() {
 }
+
+void Function::find_repeated_param() {
+  m_first_repeated_param = unsigned(m_params.size());
+  for (unsigned i = 1; i < m_params.size() && m_first_repeated_param == m_params.size(); i++) {
+    for (unsigned j = 0; j < i; j++) {
+      if (m_params[i] == m_params[j]) {
+        m_first_repeated_param = i;
+        break;
+      }
+    }
+  }
+}
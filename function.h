@@ -4,29 +4,40 @@
 #include <vector>
 #include <string>
 #include "valrep.h"
+#include "symtab.h"
+#include "flat_ast.h"
 class Environment;
 class Node;
 
 class Function : public ValRep {
 private:
   std::string m_name;
-  std::vector<std::string> m_params;
+  std::vector<Symbol> m_params;
   Environment *m_parent_env;
   Node *m_body;
+  FlatNodeRef m_flat_body; // if defined in a FlatAST
+  unsigned m_first_repeated_param;
+
+  void find_repeated_param();
 
   // value semantics prohibited
   Function(const Function &);
   Function &operator=(const Function &);
 
 public:
-  Function(const std::string &name, const std::vector<std::string> &params, Environment *parent_env, Node *body);
+  Function(const std::string &name, const std::vector<Symbol> &params, Environment *parent_env, Node *body);
+  Function(const std::string &name, const std::vector<Symbol> &params, Environment *parent_env, FlatNodeRef body);
   virtual ~Function();
 
   std::string get_name() const { return m_name; }
-  const std::vector<std::string> &get_params() const { return m_params; }
+  const std::vector<Symbol> &get_params() const { return m_params; }
   unsigned get_num_params() const { return unsigned(m_params.size()); }
+  // index of the first parameter with the same name as an earlier one,
+  // or the number of parameters if there is none
+  unsigned get_first_repeated_param() const { return m_first_repeated_param; }
   Environment *get_parent_env() const { return m_parent_env; }
   Node *get_body() const { return m_body; }
+  FlatNodeRef get_flat_body() const { return m_flat_body; }
 };
 
 #endif // FUNCTION_H
@@ -8,80 +8,133 @@
 #include "array.h"
 #include "string_literal.h"
 #include "intrinsic.h"
+#include "parser2.h"
+#include "resolver.h"
+#include "optimizer.h"
+
+
+namespace {
+
+// Get the body of a Function defined in a Node tree, parsing (and
+// resolving and optimizing) it first if the parser deferred it.
+Node *function_body(Function *fn) {
+    Node *body = fn->get_body();
+    if (body->get_tag() == AST_DEFERRED_BODY) {
+        DeferredBody *deferred = static_cast<DeferredBody *>(body);
+        body = deferred->get_body();
+        if (body->get_scope().num_slots < 0) {
+            ScopeResolver().resolve_function(fn->get_params(), body);
+            Optimizer(deferred->get_arena()).optimize_function(body);
+        }
+    }
+    return body;
+}
 
+}
 
-std::unique_ptr<Environment> testing_env(new Environment(nullptr));
 std::unique_ptr<Environment> global_env(new Environment(nullptr));
 
-Interpreter::Interpreter(Node *ast_to_adopt)
-        : m_ast(ast_to_adopt) {
+Interpreter::Interpreter(Node *ast, Arena *arena_to_adopt)
+        : m_ast(ast), m_arena(arena_to_adopt), m_verbose(false) {
+}
+
+Interpreter::Interpreter(FlatAST *flat_to_adopt)
+        : m_ast(nullptr), m_flat(flat_to_adopt), m_verbose(false) {
 }
 
 Interpreter::~Interpreter() {
-    delete m_ast;
 }
 
 void Interpreter::analyze() {
-    add_intrinsic(testing_env.get());
-    search_for_semantic(m_ast, testing_env.get());
+    ScopeResolver().resolve_unit(m_ast);
+    Optimizer optimizer(m_arena.get());
+    optimizer.set_verbose(m_verbose);
+    // drop the bodies of functions nothing refers to before the other
+    // passes spend time on them, then again for those only the code
+    // they removed referred to
+    optimizer.remove_unused_functions(m_ast);
+    optimizer.optimize_unit(m_ast);
+    optimizer.inline_functions(m_ast);
+    optimizer.hoist_invariants(m_ast);
+    optimizer.remove_unused_functions(m_ast);
 }
 
-void Interpreter::search_for_semantic(Node *ast, Environment *test_env) {
-    int tag = ast->get_tag();
-
-    switch (tag) {
-        case AST_VARDEF:
-            test_env->new_variable(ast->get_last_kid()->get_str(), ast->get_last_kid()->get_loc(), VALUE_INT);
-        case AST_VARREF:
-            test_env->get_variable(ast->get_str(), ast->get_loc());
-        case AST_UNIT:
-        case AST_STATEMENT_LIST: {
-            std::unique_ptr<Environment> new_env(new Environment(test_env));
-            for (unsigned i = 0; i < ast->get_num_kids(); i++) {
-                search_for_semantic(ast->get_kid(i), new_env.get());
-            }
-        }
-        default:
-            break;
+void Interpreter::add_intrinsic(Environment *env) {
+    const Location &loc = m_flat ? m_flat->get_root()->get_loc() : m_ast->get_loc();
+    // Bind all intrinsic functions (see intrinsic.cpp)
+    for (const IntrinsicInfo *info = intrinsics; info->name != nullptr; info++) {
+        env->bind(symtab::intern(info->name), loc, IntrinsicFn(info->fn));
     }
-
 }
 
-void Interpreter::add_intrinsic(Environment *env) {
-    // From intrinsic.cpp
-    // Bind all intrinsic functions
-    // I/O
-    env->bind("print", m_ast->get_loc(), IntrinsicFn(intrinsic_print));
-    env->bind("println", m_ast->get_loc(), IntrinsicFn(intrinsic_println));
-    env->bind("readint", m_ast->get_loc(), IntrinsicFn(intrinsic_readint));
-    // Arrays
-    env->bind("mkarr", m_ast->get_loc(), IntrinsicFn(intrinsic_mkarr));
-    env->bind("len", m_ast->get_loc(), IntrinsicFn(intrinsic_len));
-    env->bind("get", m_ast->get_loc(), IntrinsicFn(intrinsic_get));
-    env->bind("set", m_ast->get_loc(), IntrinsicFn(intrinsic_set));
-    env->bind("pop", m_ast->get_loc(), IntrinsicFn(intrinsic_pop));
-    env->bind("push", m_ast->get_loc(), IntrinsicFn(intrinsic_push));
-    // Strings
-    env->bind("strlen", m_ast->get_loc(), IntrinsicFn(intrinsic_strlen));
-    env->bind("strcat", m_ast->get_loc(), IntrinsicFn(intrinsic_strcat));
-    env->bind("substr", m_ast->get_loc(), IntrinsicFn(intrinsic_substr));
+void Interpreter::flatten() {
+    m_flat.reset(new FlatAST(m_ast));
+    // the Node tree is no longer needed
+    m_ast = nullptr;
+    m_arena.reset();
 }
 
 Value Interpreter::execute() {
     add_intrinsic(global_env.get());
+    if (m_flat) {
+        m_modules.set_main(m_flat->get_root()->get_loc().get_srcfile());
+        m_modules.preload(m_flat->get_root());
+        return execute_prime(m_flat->get_root(), global_env.get());
+    }
+    m_modules.set_main(m_ast->get_loc().get_srcfile());
+    m_modules.preload(m_ast);
     return execute_prime(m_ast, global_env.get());
 }
 
-Value Interpreter::execute_prime(Node *ast, Environment *env) {
+Value Interpreter::execute_streaming(Parser2 *parser) {
+    add_intrinsic(global_env.get());
+
+    // Each statement is parsed into a scratch arena, which is cleared
+    // once the statement has run. A function definition goes in m_arena
+    // instead, since the Function value refers to the body.
+    Arena scratch;
+    ScopeResolver resolver;
+    Value final;
+    bool first = true;
+    for (;;) {
+        Arena *arena = parser->at_function() ? m_arena.get() : &scratch;
+        parser->set_arena(arena);
+        Node *stmt = parser->parse_next();
+        if (stmt == nullptr) {
+            break;
+        }
+        if (first) {
+            m_modules.set_main(stmt->get_loc().get_srcfile());
+            first = false;
+        }
+        resolver.resolve_top_level(stmt);
+        Optimizer optimizer(arena);
+        optimizer.set_verbose(m_verbose);
+        optimizer.optimize_top_level(stmt);
+        final = execute_prime(stmt, global_env.get());
+        if (arena == m_arena.get()) {
+            m_ast->append_kid(stmt);
+        } else {
+            scratch.reset();
+        }
+    }
+    return final;
+}
+
+template<typename NodeRef>
+Value Interpreter::execute_prime(NodeRef ast, Environment *env) {
     int tag = ast->get_tag();
 
     switch (ast->get_tag()) {
         case AST_STATEMENT_LIST: {
-            // enter new scope
-            Environment new_env(env);
-
-            Value final = execute_statement_list(ast, &new_env);
-            return final;
+            int num_slots = ast->get_scope().num_slots;
+            if (num_slots < 0) {
+                // the block's variables are in the current frame
+                return execute_statement_list(ast, env);
+            }
+            // a block at the top level has a frame of its own
+            Environment frame(env, unsigned(num_slots));
+            return execute_statement_list(ast, &frame);
         }
         case AST_UNIT:
             return execute_statement_list(ast, env);
@@ -104,12 +157,12 @@ Value Interpreter::execute_prime(Node *ast, Environment *env) {
                     case VALUE_FUNCTION: {
                         // extract function from environment
                         Function *fn = get_variable(ast, env).get_function();
-                        Environment func_env(fn->get_parent_env());
-                        // bind the parameters to the arguments within the function scope
-                        // add local env as the execution env of the arguments
-                        bind_params(fn, &func_env, env, ast->get_kid(0));
-                        // execute the ast tree shard
-                        return execute_prime(fn->get_body(), &func_env);
+                        // execute the ast tree shard, in the layout the function
+                        // was defined in (imported modules are always FlatASTs)
+                        if (fn->get_body() != nullptr) {
+                            return call_function(fn, function_body(fn), ast->get_kid(0), env);
+                        }
+                        return call_function(fn, fn->get_flat_body(), ast->get_kid(0), env);
                     }
                     case VALUE_ARRAY:
                     case VALUE_STRING:
@@ -121,21 +174,46 @@ Value Interpreter::execute_prime(Node *ast, Environment *env) {
         case AST_VARDEF:
             return define_variable(ast, env);
         case AST_FUNCTION: {
-            std::vector<std::string> params;
-            // add list of param strings
+            std::vector<Symbol> params;
+            // add list of param symbols
             for (unsigned i = 0; i < ast->get_kid(1)->get_num_kids(); i++) {
-                params.push_back(ast->get_kid(1)->get_kid(i)->get_str());
+                params.push_back(ast->get_kid(1)->get_kid(i)->get_sym());
             }
-            Value fn_val(new Function(ast->get_kid(0)->get_str(), params, global_env.get(), ast->get_kid(2)));
-            env->bind(fn_val.get_function()->get_name(), ast->get_loc(), fn_val);
+            Value fn_val(new Function(std::string(ast->get_kid(0)->get_str()), params, global_env.get(), ast->get_kid(2)));
+            declare(ast->get_kid(0), ast->get_loc(), fn_val, env);
             return {};
         }
+        case AST_IMPORT:
+            import_module(ast);
+            return {};
+        case AST_INLINE_CALL: {
+            // a call the Optimizer replaced by a copy of the function's
+            // body, whose variables (parameters first) are in this frame
+            unsigned num_args = ast->get_num_kids() - 1;
+            int first = ast->get_scope().slot;
+            for (unsigned i = 0; i < num_args; i++) {
+                env->get_slot(first + int(i)) = execute_prime(ast->get_kid(i), env);
+            }
+            return execute_statement_list(ast->get_last_kid(), env);
+        }
+        case AST_INVARIANT:
+            return invariant_value(ast, env);
         case AST_INT_LITERAL:
             return int_literal(ast);
         case AST_STRING:
             return string_literal(ast);
-        case AST_ASSIGN:
-            return set_variable(ast->get_kid(0), execute_prime(ast->get_kid(1), env), env);
+        case AST_ASSIGN: {
+            NodeRef lhs = ast->get_kid(0);
+            const ScopeInfo &scope = lhs->get_scope();
+            if (scope.always_int) {
+                // then so is the value assigned
+                int ival;
+                eval_int(ast->get_kid(1), env, ival);
+                env->get_frame(scope.depth)->get_slot(scope.slot).set_ival(ival);
+                return {ival};
+            }
+            return set_variable(lhs, execute_prime(ast->get_kid(1), env), env);
+        }
         case AST_ARGLIST: {
             EvaluationError::raise(ast->get_loc(), "Argument list made child of non function call");
         }
@@ -150,18 +228,36 @@ Value Interpreter::execute_prime(Node *ast, Environment *env) {
         case AST_GREATEREQUAL:
         case AST_EQUAL:
         case AST_NOTEQUAL:
-            return binary_op(ast, env);
+            return {binary_op(ast, env)};
         case AST_ADD:
         case AST_SUB:
         case AST_MULTIPLY:
         case AST_DIVIDE:
-            return do_math(ast, env);
+            return {do_math(ast, env)};
         default:
             RuntimeError::raise("Unknown AST node type %d\n", tag);
     }
 }
 
-Value Interpreter::execute_statement_list(Node *ast, Environment *env) {
+template<typename NodeRef>
+void Interpreter::import_module(NodeRef ast) {
+    Module *module = m_modules.get(ast->get_loc().get_srcfile(), std::string(ast->get_str()));
+    if (module->imported) {
+        return;
+    }
+    if (module->error) {
+        std::rethrow_exception(module->error);
+    }
+    if (!module->ast) {
+        EvaluationError::raise(ast->get_loc(), "Could not open module '%s'", std::string(ast->get_str()).c_str());
+    }
+    // mark it first, so that an import cycle ends here
+    module->imported = true;
+    execute_prime(module->ast->get_root(), global_env.get());
+}
+
+template<typename NodeRef>
+Value Interpreter::execute_statement_list(NodeRef ast, Environment *env) {
     Value final;
 
     for (unsigned i = 0; i < ast->get_num_kids(); i++) {
@@ -170,23 +266,121 @@ Value Interpreter::execute_statement_list(Node *ast, Environment *env) {
     return final;
 }
 
-void Interpreter::bind_params(Function *fn, Environment *env, Environment *local_env, Node *arg_list) {
-    std::vector<std::string> params = fn->get_params();
+template<typename BodyRef, typename NodeRef>
+Value Interpreter::call_function(Function *fn, BodyRef body, NodeRef arg_list, Environment *env) {
+    Environment frame(fn->get_parent_env(), unsigned(body->get_scope().num_slots));
+    // bind the parameters to the arguments within the function scope
+    // add local env as the execution env of the arguments
+    bind_params(fn, &frame, env, arg_list);
+    // the body's block runs in the function's frame
+    return execute_statement_list(body, &frame);
+}
+
+template<typename NodeRef>
+void Interpreter::bind_params(Function *fn, Environment *env, Environment *local_env, NodeRef arg_list) {
+    const std::vector<Symbol> &params = fn->get_params();
 
     if (fn->get_params().size() != arg_list->get_num_kids()) {
         EvaluationError::raise(arg_list->get_loc(), "Wrong number of arguments to function %s", fn->get_name().c_str());
     }
 
-    // bind all parameters to passed in values
-    for (long unsigned int i = 0; i < params.size(); i++) {
+    // bind all parameters to passed in values: parameter i is in slot i
+    for (unsigned i = 0; i < params.size(); i++) {
         // local env is where each argument is evaluated, env is where the params will be bound
-        env->bind(params.at(i), arg_list->get_loc(), execute_prime(arg_list->get_kid(i), local_env));
+        env->get_slot(int(i)) = execute_prime(arg_list->get_kid(i), local_env);
+        if (i == fn->get_first_repeated_param()) {
+            SemanticError::raise(arg_list->get_loc(), "Variable %s already exists",
+                                 symtab::get_name(params[i]).c_str());
+        }
+    }
+}
+
+// Evaluate an expression whose value must be an int, without making a
+// Value where possible: operators and int literals always produce ints,
+// and so do the local variables ScopeResolver found to always hold
+// one, and assignments to them; other variables are checked where they
+// are. Anything else is
+// evaluated as usual and checked. Returns false if the value isn't an
+// int, describing it in *non_int if that's given.
+template<typename NodeRef>
+bool Interpreter::eval_int(NodeRef ast, Environment *env, int &ival, std::string *non_int) {
+    switch (ast->get_tag()) {
+        case AST_INT_LITERAL:
+            ival = int_value(ast);
+            return true;
+        case AST_ADD:
+        case AST_SUB:
+        case AST_MULTIPLY:
+        case AST_DIVIDE:
+            ival = do_math(ast, env);
+            return true;
+        case AST_AND:
+        case AST_OR:
+        case AST_LESS:
+        case AST_LESSEQUAL:
+        case AST_GREATER:
+        case AST_GREATEREQUAL:
+        case AST_EQUAL:
+        case AST_NOTEQUAL:
+            ival = binary_op(ast, env);
+            return true;
+        case AST_VARREF:
+            if (ast->get_num_kids() == 0) {
+                const ScopeInfo &scope = ast->get_scope();
+                if (scope.always_int) {
+                    ival = env->get_frame(scope.depth)->get_slot(scope.slot).get_ival();
+                    return true;
+                }
+                const Value &val = get_variable(ast, env);
+                if (val.is_numeric()) {
+                    ival = val.get_ival();
+                    return true;
+                }
+                if (non_int != nullptr) {
+                    *non_int = val.as_str();
+                }
+                return false;
+            }
+            break;
+        case AST_ASSIGN: {
+            const ScopeInfo &scope = ast->get_kid(0)->get_scope();
+            if (scope.always_int) {
+                eval_int(ast->get_kid(1), env, ival);
+                env->get_frame(scope.depth)->get_slot(scope.slot).set_ival(ival);
+                return true;
+            }
+            break;
+        }
+        case AST_INVARIANT: {
+            const Value &val = invariant_value(ast, env);
+            if (val.is_numeric()) {
+                ival = val.get_ival();
+                return true;
+            }
+            if (non_int != nullptr) {
+                *non_int = val.as_str();
+            }
+            return false;
+        }
+        default:
+            break;
+    }
+
+    Value val = execute_prime(ast, env);
+    if (val.is_numeric()) {
+        ival = val.get_ival();
+        return true;
     }
+    if (non_int != nullptr) {
+        *non_int = val.as_str();
+    }
+    return false;
 }
 
-void Interpreter::try_if(Node *ast, Environment *env) {
+template<typename NodeRef>
+void Interpreter::try_if(NodeRef ast, Environment *env) {
     check_condition(ast, env);
-    if (execute_prime(ast->get_kid(0), env).get_ival()) {
+    if (check_condition(ast, env)) {
         execute_prime(ast->get_kid(1), env);
 
     } else {
@@ -198,168 +392,248 @@ void Interpreter::try_if(Node *ast, Environment *env) {
 
 }
 
-void Interpreter::try_while(Node *ast, Environment *env) {
-    check_condition(ast, env);
+template<typename NodeRef>
+void Interpreter::try_while(NodeRef ast, Environment *env) {
+    NodeRef body = ast->get_kid(1);
+    int num_slots = body->get_scope().num_slots;
+    if (num_slots < 0) {
+        // the body's variables are in the current frame
+        run_loop(ast, env, env);
+        return;
+    }
+    // a loop at the top level, whose body has a frame of its own: each
+    // iteration can use the same one, since a local is set afresh each
+    // time its declaration runs
+    Environment frame(env, unsigned(num_slots));
+    run_loop(ast, env, &frame);
+}
 
-    Value condition = execute_prime(ast->get_kid(0), env);
+template<typename NodeRef>
+void Interpreter::run_loop(NodeRef ast, Environment *env, Environment *body_env) {
+    // the values of the loop's invariants are worked out again each
+    // time the loop starts
+    const ScopeInfo &scope = ast->get_scope();
+    for (int i = 0; i < scope.num_slots; i += 2) {
+        body_env->get_slot(scope.slot + i).set_ival(0);
+    }
 
-    while (condition.get_ival()) {
-        execute_prime(ast->get_kid(1), env);
-        condition = execute_prime(ast->get_kid(0), env);
+    NodeRef body = ast->get_kid(1);
+    check_condition(ast, env);
+    while (check_condition(ast, env)) {
+        execute_statement_list(body, body_env);
     }
 }
 
-void Interpreter::check_condition(Node *ast, Environment *env) {
+// The value of an expression the Optimizer found doesn't change while
+// the loop around it runs: worked out the first time it is needed, and
+// kept in the second of its slots, with 1 in the first once it's there.
+template<typename NodeRef>
+const Value &Interpreter::invariant_value(NodeRef ast, Environment *env) {
+    int slot = ast->get_scope().slot;
+    const Value &known = env->get_slot(slot);
+    if (!known.is_numeric() || known.get_ival() != 1) {
+        Value val = execute_prime(ast->get_kid(0), env);
+        env->get_slot(slot + 1) = val;
+        env->get_slot(slot).set_ival(1);
+    }
+    return env->get_slot(slot + 1);
+}
 
-    Value kind = execute_prime(ast->get_kid(0), env);
+template<typename NodeRef>
+int Interpreter::check_condition(NodeRef ast, Environment *env) {
+    int condition;
     // check we are using an int as a condition
-    if (kind.is_numeric()) {
-        return;
+    if (!eval_int(ast->get_kid(0), env, condition)) {
+        EvaluationError::raise(ast->get_loc(), "Statement condition is not numeric");
     }
-    EvaluationError::raise(ast->get_loc(), "Statement condition is not numeric");
+    return condition;
 }
 
 
-Value Interpreter::define_variable(Node *ast, Environment *env) {
-    env->new_variable(ast->get_last_kid()->get_str(), ast->get_last_kid()->get_loc(), VALUE_INT);
+template<typename NodeRef>
+Value Interpreter::define_variable(NodeRef ast, Environment *env) {
+    NodeRef name = ast->get_last_kid();
+    declare(name, name->get_loc(), VALUE_INT, env);
     return {0};
 }
 
-Value Interpreter::get_variable(Node *ast, Environment *env) {
-    return env->get_variable(ast->get_str(), ast->get_loc());
+template<typename NodeRef>
+void Interpreter::declare(NodeRef name, const Location &loc, const Value &val, Environment *env) {
+    const ScopeInfo &scope = name->get_scope();
+    switch (scope.slot) {
+        case ScopeInfo::GLOBAL:
+            env->get_frame(scope.depth)->bind(name->get_sym(), loc, val);
+            break;
+        case ScopeInfo::REDECLARED:
+            SemanticError::raise(loc, "Variable %s already exists", std::string(name->get_str()).c_str());
+        default:
+            // a local is set afresh each time its declaration runs
+            env->get_frame(scope.depth)->get_slot(scope.slot) = val;
+            break;
+    }
+}
+
+template<typename NodeRef>
+const Value &Interpreter::get_variable(NodeRef ast, Environment *env) {
+    const ScopeInfo &scope = ast->get_scope();
+    Environment *frame = env->get_frame(scope.depth);
+    if (scope.slot == ScopeInfo::GLOBAL) {
+        return frame->get_variable(ast->get_sym(), ast->get_loc());
+    }
+    return frame->get_slot(scope.slot);
 }
 
-Value Interpreter::set_variable(Node *ast, const Value &val, Environment *env) {
-    env->set_variable(ast->get_str(), val, ast->get_loc());
+template<typename NodeRef>
+Value Interpreter::set_variable(NodeRef ast, const Value &val, Environment *env) {
+    const ScopeInfo &scope = ast->get_scope();
+    Environment *frame = env->get_frame(scope.depth);
+    if (scope.slot == ScopeInfo::GLOBAL) {
+        frame->set_variable(ast->get_sym(), val, ast->get_loc());
+    } else {
+        frame->get_slot(scope.slot) = val;
+    }
     return {val};
 }
 
-Value Interpreter::do_math(Node *ast, Environment *env) {
+template<typename NodeRef>
+int Interpreter::do_math(NodeRef ast, Environment *env) {
     int tag = ast->get_tag();
 
-    Value lhs_val = execute_prime(ast->get_kid(0), env);
-    Value rhs_val = execute_prime(ast->get_kid(1), env);
+    int lhs, rhs;
+    bool lhs_ok = eval_int(ast->get_kid(0), env, lhs);
+    bool rhs_ok = eval_int(ast->get_kid(1), env, rhs);
 
     // verify we are doing math on ints
-    if (!lhs_val.is_numeric() || !rhs_val.is_numeric()) {
+    if (!lhs_ok || !rhs_ok) {
         EvaluationError::raise(ast->get_loc(), "Operand is not numeric");
     }
 
-    int lhs = lhs_val.get_ival();
-    int rhs = rhs_val.get_ival();
-
     switch (tag) {
         case AST_ADD:
-            return {lhs + rhs};
+            return lhs + rhs;
         case AST_SUB:
-            return {lhs - rhs};
+            return lhs - rhs;
         case AST_MULTIPLY:
-            return {lhs * rhs};
+            return lhs * rhs;
         case AST_DIVIDE:
             if (rhs == 0) {
                 EvaluationError::raise(ast->get_loc(), "Divide by 0");
             }
-            return {lhs / rhs};
+            return lhs / rhs;
         default:
-            EvaluationError::raise(ast->get_loc(), "Invalid math for operator %s", ast->get_str().c_str());
+            EvaluationError::raise(ast->get_loc(), "Invalid math for operator %s", std::string(ast->get_str()).c_str());
     }
 }
 
-Value Interpreter::binary_op(Node *ast, Environment *env) {
+template<typename NodeRef>
+int Interpreter::binary_op(NodeRef ast, Environment *env) {
 
     int tag = ast->get_tag();
-    Value lhs_val = execute_prime(ast->get_kid(0), env);
+    int lhs, rhs;
+    std::string non_int;
 
     // check something weird isn't being passed in
-    if (!lhs_val.is_numeric()) {
-        EvaluationError::raise(ast->get_loc(), "%s passed into binary operation", lhs_val.as_str().c_str());
+    if (!eval_int(ast->get_kid(0), env, lhs, &non_int)) {
+        EvaluationError::raise(ast->get_loc(), "%s passed into binary operation", non_int.c_str());
     }
-    int lhs = lhs_val.get_ival();
 
     // Short circuit the OR and AND binary operations
     switch (tag) {
         case AST_AND:
             if (lhs == 0) {
-                return {0};
+                return 0;
             }
             break;
         case AST_OR:
             if (lhs == 1) {
-                return {1};
+                return 1;
             }
             break;
         default:
             break;
     }
 
-    Value rhs_val = execute_prime(ast->get_kid(1), env);
-
     // check something weird isn't being passed in
-    if (!rhs_val.is_numeric()) {
-        EvaluationError::raise(ast->get_loc(), "%s passed into binary operation", rhs_val.as_str().c_str());
+    if (!eval_int(ast->get_kid(1), env, rhs, &non_int)) {
+        EvaluationError::raise(ast->get_loc(), "%s passed into binary operation", non_int.c_str());
     }
-    int rhs = rhs_val.get_ival();
 
     switch (tag) {
         case AST_AND:
             if (lhs == 1 && rhs == 1) {
-                return {1};
+                return 1;
             }
             break;
         case AST_OR:
             if (lhs != 0 || rhs != 0) {
-                return {1};
+                return 1;
             }
             break;
         case AST_LESS:
             if (lhs < rhs) {
-                return {1};
+                return 1;
             }
             break;
         case AST_LESSEQUAL:
             if (lhs <= rhs) {
-                return {1};
+                return 1;
             }
             break;
         case AST_GREATER:
             if (lhs > rhs) {
-                return {1};
+                return 1;
             }
             break;
         case AST_GREATEREQUAL:
             if (lhs >= rhs) {
-                return {1};
+                return 1;
             }
             break;
         case AST_EQUAL:
             if (lhs == rhs) {
-                return {1};
+                return 1;
             }
             break;
         case AST_NOTEQUAL:
             if (lhs != rhs) {
-                return {1};
+                return 1;
             }
             break;
         default:
-            EvaluationError::raise(ast->get_loc(), "Invalid binary math for operator %s", ast->get_str().c_str());
+            EvaluationError::raise(ast->get_loc(), "Invalid binary math for operator %s", std::string(ast->get_str()).c_str());
     }
-    return {0};
+    return 0;
+}
+
+template<typename NodeRef>
+Value Interpreter::int_literal(NodeRef ast) {
+    return {int_value(ast)};
 }
 
-Value Interpreter::int_literal(Node *ast) {
-    return {std::stoi(ast->get_str())};
+template<typename NodeRef>
+int Interpreter::int_value(NodeRef ast) {
+    // worked out by the Optimizer (or when the FlatAST was built), unless
+    // the program wasn't optimized or it doesn't fit in an int
+    if (ast->has_int_value()) {
+        return ast->get_int_value();
+    }
+    int val;
+    if (!int_literal_value(ast->get_str(), val)) {
+        EvaluationError::raise(ast->get_loc(), "Integer literal %s is out of range", std::string(ast->get_str()).c_str());
+    }
+    return val;
 }
 
-Value Interpreter::string_literal(Node *ast) {
-    return new String(ast->get_str());
+template<typename NodeRef>
+Value Interpreter::string_literal(NodeRef ast) {
+    return new String(std::string(ast->get_str()));
 }
 
 
-Value Interpreter::call_intrinsic(Node *ast, Environment *env) {
+template<typename NodeRef>
+Value Interpreter::call_intrinsic(NodeRef ast, Environment *env) {
 
-    std::string name = ast->get_str();
-    Node *arg_list = ast->get_kid(0);
+    NodeRef arg_list = ast->get_kid(0);
     Value args[arg_list->get_num_kids()];
 
     for (unsigned i = 0; i < arg_list->get_num_kids(); i++) {
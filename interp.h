@@ -1,62 +1,145 @@
 #ifndef INTERP_H
 #define INTERP_H
 
+#include <memory>
+#include <vector>
 #include "value.h"
 #include "environment.h"
+#include "arena.h"
+#include "flat_ast.h"
+#include "module.h"
 
 class Node;
 
 class Location;
 
+class Parser2;
+
 class Interpreter {
 private:
     Node *m_ast;
+    // the arena holding m_ast, and the function definitions kept by
+    // execute_streaming()
+    std::unique_ptr<Arena> m_arena;
+    // if set, the program is executed from here (see flatten())
+    std::unique_ptr<FlatAST> m_flat;
+    // modules loaded by import statements
+    ModuleLoader m_modules;
+    // whether to report what the Optimizer removes
+    bool m_verbose;
 
 public:
-    explicit Interpreter(Node *ast_to_adopt);
+    // The AST must have been allocated in the given arena, which is
+    // deleted (freeing the AST) along with the Interpreter.
+    Interpreter(Node *ast, Arena *arena_to_adopt);
+
+    // Execute an already analyzed FlatAST (e.g. one loaded from a
+    // ProgramCache), which is deleted along with the Interpreter.
+    explicit Interpreter(FlatAST *flat_to_adopt);
 
     ~Interpreter();
 
+    // Work out where each variable lives (see ScopeResolver), then
+    // simplify the AST (see Optimizer). Must be called before execute()
+    // or flatten().
     void analyze();
 
+    // Report the code the Optimizer removes from the program, and the
+    // calls it inlines (but not in modules or function bodies parsed
+    // later), on stderr.
+    void set_verbose(bool verbose) { m_verbose = verbose; }
+
+    // Keep compiled modules in a ProgramCache in this directory.
+    void set_module_cache_dir(const std::string &dir) { m_modules.set_cache_dir(dir); }
+
+    // Convert the AST to a FlatAST, which execute() will then use,
+    // and free the original. Must be called before execute(), and
+    // function bodies must not have been deferred.
+    void flatten();
+
+    // The FlatAST made by flatten(), or nullptr.
+    const FlatAST *get_flat() const { return m_flat.get(); }
+
     Value execute();
 
+    // Execute the program one top-level statement at a time as the
+    // parser produces them, rather than parsing it all first.
+    // Statements are freed once they have run, except for function
+    // definitions, which are added to the unit passed to the
+    // constructor.
+    Value execute_streaming(Parser2 *parser);
+
 private:
 
-    void search_for_semantic(Node *ast, Environment *test_env);
+    // The evaluator below is written once for both AST layouts:
+    // NodeRef is either Node * or FlatNodeRef.
+    template<typename NodeRef>
+    int do_math(NodeRef ast, Environment *env);
 
-    Value do_math(Node *ast, Environment *env);
+    template<typename NodeRef>
+    int binary_op(NodeRef ast, Environment *env);
 
-    Value binary_op(Node *ast, Environment *env);
+    template<typename NodeRef>
+    bool eval_int(NodeRef ast, Environment *env, int &ival, std::string *non_int = nullptr);
 
-    static Value define_variable(Node *ast, Environment *env);
+    template<typename NodeRef>
+    static Value define_variable(NodeRef ast, Environment *env);
 
-    static Value get_variable(Node *ast, Environment *env);
+    template<typename NodeRef>
+    static void declare(NodeRef name, const Location &loc, const Value &val, Environment *env);
 
-    Value execute_prime(Node *ast, Environment *env);
+    template<typename NodeRef>
+    static const Value &get_variable(NodeRef ast, Environment *env);
 
-    static Value int_literal(Node *ast);
+    template<typename NodeRef>
+    Value execute_prime(NodeRef ast, Environment *env);
 
-    void try_if(Node *ast, Environment *env);
+    template<typename NodeRef>
+    static Value int_literal(NodeRef ast);
 
-    void try_while(Node *ast, Environment *env);
+    template<typename NodeRef>
+    static int int_value(NodeRef ast);
 
-    static Value set_variable(Node *ast, const Value &val, Environment *env);
+    template<typename NodeRef>
+    void try_if(NodeRef ast, Environment *env);
 
+    template<typename NodeRef>
+    void try_while(NodeRef ast, Environment *env);
 
-    Value call_intrinsic(Node *ast, Environment *env);
+    template<typename NodeRef>
+    void run_loop(NodeRef ast, Environment *env, Environment *body_env);
+
+    template<typename NodeRef>
+    const Value &invariant_value(NodeRef ast, Environment *env);
+
+    template<typename NodeRef>
+    static Value set_variable(NodeRef ast, const Value &val, Environment *env);
+
+
+    template<typename NodeRef>
+    Value call_intrinsic(NodeRef ast, Environment *env);
 
     void add_intrinsic(Environment *env);
 
-    Value execute_statement_list(Node *ast, Environment *env);
+    template<typename NodeRef>
+    void import_module(NodeRef ast);
+
+    template<typename NodeRef>
+    Value execute_statement_list(NodeRef ast, Environment *env);
+
+    template<typename NodeRef>
+    int check_condition(NodeRef ast, Environment *env);
 
-    void check_condition(Node *ast, Environment *env);
 
+    template<typename BodyRef, typename NodeRef>
+    Value call_function(Function *fn, BodyRef body, NodeRef arg_list, Environment *env);
 
-    void bind_params(Function *fn, Environment *env, Environment *local_env, Node *arg_list);
+    template<typename NodeRef>
+    void bind_params(Function *fn, Environment *env, Environment *local_env, NodeRef arg_list);
 
 
-    static Value string_literal(Node *ast);
+    template<typename NodeRef>
+    static Value string_literal(NodeRef ast);
 };
 
 #endif // INTERP_H
@@ -122,3 +122,22 @@ Value intrinsic_pop(Value *args, unsigned int num_args, const Location &loc) {
         EvaluationError::raise(loc, "Pop call not passed array type");
     return args[0].get_array()->pop();
 }
+
+const IntrinsicInfo intrinsics[] = {
+    // I/O
+    {"print", intrinsic_print, INTRINSIC_OTHER_EFFECT},
+    {"println", intrinsic_println, INTRINSIC_OTHER_EFFECT},
+    {"readint", intrinsic_readint, INTRINSIC_OTHER_EFFECT},
+    // Arrays
+    {"mkarr", intrinsic_mkarr, INTRINSIC_OTHER_EFFECT},
+    {"len", intrinsic_len, INTRINSIC_READS_ARRAYS},
+    {"get", intrinsic_get, INTRINSIC_READS_ARRAYS},
+    {"set", intrinsic_set, INTRINSIC_WRITES_ARRAYS},
+    {"pop", intrinsic_pop, INTRINSIC_WRITES_ARRAYS},
+    {"push", intrinsic_push, INTRINSIC_WRITES_ARRAYS},
+    // Strings
+    {"strlen", intrinsic_strlen, INTRINSIC_PURE},
+    {"strcat", intrinsic_strcat, INTRINSIC_PURE},
+    {"substr", intrinsic_substr, INTRINSIC_PURE},
+    {nullptr, nullptr, INTRINSIC_PURE},
+};
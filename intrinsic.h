@@ -34,4 +34,23 @@ extern Value intrinsic_strcat(Value *args, unsigned int num_args, const Location
 
 extern Value intrinsic_strlen(Value *args, unsigned int num_args, const Location &loc);
 
+// What a call of an intrinsic does besides working out its result from
+// its arguments, which the Optimizer needs to know to move calls
+enum IntrinsicEffect {
+    INTRINSIC_PURE,          // nothing
+    INTRINSIC_READS_ARRAYS,  // its result depends on what is in an array
+    INTRINSIC_OTHER_EFFECT,  // I/O, or making a new array
+    INTRINSIC_WRITES_ARRAYS, // changes what is in an array
+};
+
+struct IntrinsicInfo {
+    const char *name;
+    IntrinsicFn fn;
+    IntrinsicEffect effect;
+};
+
+// The intrinsics every program starts with, ending with an entry whose
+// name is nullptr
+extern const IntrinsicInfo intrinsics[];
+
 #endif //COMPILERS_1_INTRINSIC_H
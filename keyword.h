@@ -0,0 +1,126 @@
+#ifndef KEYWORD_H
+#define KEYWORD_H
+
+#include <cstddef>
+#include <cstring>
+#include "token.h"
+
+// Keyword recognition for the lexer.
+// A collision-free (perfect) hash over the keyword set is generated at
+// compile time, so classifying an identifier costs one hash of a short
+// string and at most one comparison, however many keywords there are.
+// To add a keyword, add its TokenKind to token.h and an entry to
+// KEYWORDS below; the table and hash seed are recomputed automatically.
+
+namespace keyword {
+
+struct Keyword {
+    const char *word;
+    TokenKind kind;
+};
+
+constexpr Keyword KEYWORDS[] = {
+        {"var",      TOK_VAR},
+        {"function", TOK_FN},
+        {"if",       TOK_IF},
+        {"else",     TOK_ELSE},
+        {"while",    TOK_WHILE},
+        {"import",   TOK_IMPORT},
+};
+
+constexpr size_t NUM_KEYWORDS = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
+
+// number of hash slots: a power of two at least twice the keyword count
+constexpr size_t table_size() {
+    size_t size = 1;
+    while (size < 2 * NUM_KEYWORDS) {
+        size *= 2;
+    }
+    return size;
+}
+
+constexpr size_t TABLE_SIZE = table_size();
+
+constexpr size_t const_strlen(const char *s) {
+    size_t len = 0;
+    while (s[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+// FNV-1a, with the seed mixed into the offset basis
+constexpr unsigned hash(const char *s, size_t len, unsigned seed) {
+    unsigned h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char) s[i]) * 16777619u;
+    }
+    // the low bits alone only depend on the low bits of the seed, which
+    // leaves too few seeds to try
+    return (h ^ (h >> 16)) & unsigned(TABLE_SIZE - 1);
+}
+
+struct Table {
+    unsigned seed;
+    size_t min_len, max_len;
+    // index into KEYWORDS for each slot, or -1 if the slot is empty
+    int slot[TABLE_SIZE];
+};
+
+// Search for the first seed under which no two keywords share a slot.
+// A seed of 0 in the result means none was found.
+constexpr Table build_table() {
+    Table t{0, 0, 0, {}};
+    t.min_len = const_strlen(KEYWORDS[0].word);
+    for (size_t i = 0; i < NUM_KEYWORDS; i++) {
+        size_t len = const_strlen(KEYWORDS[i].word);
+        t.min_len = len < t.min_len ? len : t.min_len;
+        t.max_len = len > t.max_len ? len : t.max_len;
+    }
+
+    for (unsigned seed = 1; seed < 100000; seed++) {
+        for (size_t i = 0; i < TABLE_SIZE; i++) {
+            t.slot[i] = -1;
+        }
+        bool ok = true;
+        for (size_t i = 0; ok && i < NUM_KEYWORDS; i++) {
+            const char *word = KEYWORDS[i].word;
+            unsigned h = hash(word, const_strlen(word), seed);
+            if (t.slot[h] >= 0) {
+                ok = false;
+            } else {
+                t.slot[h] = int(i);
+            }
+        }
+        if (ok) {
+            t.seed = seed;
+            return t;
+        }
+    }
+    return t;
+}
+
+constexpr Table TABLE = build_table();
+
+static_assert(TABLE.seed != 0, "no perfect hash seed for the keyword set; increase TABLE_SIZE");
+
+// Return the TokenKind of the keyword spelled by the len characters at s,
+// or otherwise if they don't spell a keyword.
+inline TokenKind lookup(const char *s, size_t len, TokenKind otherwise) {
+    if (len < TABLE.min_len || len > TABLE.max_len) {
+        return otherwise;
+    }
+    int index = TABLE.slot[hash(s, len, TABLE.seed)];
+    if (index < 0) {
+        return otherwise;
+    }
+    const char *word = KEYWORDS[index].word;
+    if (strncmp(word, s, len) != 0 || word[len] != '\0') {
+        return otherwise;
+    }
+    return KEYWORDS[index].kind;
+}
+
+}
+
+#endif // KEYWORD_H
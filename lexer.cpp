@@ -1,66 +1,302 @@
-#include <map>
 #include <cassert>
 #include <cctype>
+#include <cstring>
 #include <string>
-#include <iostream>
+#include <vector>
 #include "token.h"
 #include "exceptions.h"
+#include "scan.h"
+#include "keyword.h"
 #include "lexer.h"
 
+namespace {
+
+// inputs smaller than this are not worth lexing in parallel
+const size_t MIN_PARALLEL_SIZE = 256 * 1024;
+
+// lex_parallel() makes several chunks per thread, so that a thread
+// that finishes early can pick up more work
+const int CHUNKS_PER_THREAD = 4;
+
+// Skip the rest of a string literal, given the position just after its
+// opening quote, following the same escape rule as read_multi_string.
+// Returns the position after the closing quote (or end).
+const char *skip_string_body(const char *p, const char *end) {
+    for (;;) {
+        p = scan::find_quote_or_escape(p, end);
+        if (p == end) {
+            return end;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+        // backslash: an escaped quote doesn't end the literal
+        p++;
+        if (p != end && *p == '"') {
+            p++;
+        }
+    }
+}
+
+// Return the first position at or after p that is not inside a string
+// literal, assuming p itself is not inside one.
+const char *skip_to_outside_string(const char *p, const char *target, const char *end) {
+    while (p < target) {
+        const char *quote = static_cast<const char *>(memchr(p, '"', target - p));
+        if (quote == nullptr) {
+            return target;
+        }
+        p = skip_string_body(quote + 1, end);
+    }
+    return p;
+}
+
+// Split [begin, end) into roughly num_chunks pieces. Pieces are cut just
+// after a newline that is not inside a string literal, which is always
+// a token boundary. Returns the cut points, including begin and end.
+std::vector<const char *> split_at_lines(const char *begin, const char *end, int num_chunks) {
+    std::vector<const char *> cuts{begin};
+    size_t step = size_t(end - begin) / size_t(num_chunks) + 1;
+    const char *p = begin;
+    while (size_t(end - p) > step) {
+        p = skip_to_outside_string(p, p + step, end);
+
+        // find the next newline outside a string literal
+        for (;;) {
+            const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+            if (nl == nullptr) {
+                p = end;
+                break;
+            }
+            const char *quote = static_cast<const char *>(memchr(p, '"', nl - p));
+            if (quote == nullptr) {
+                p = nl + 1;
+                break;
+            }
+            p = skip_string_body(quote + 1, end);
+        }
+        if (p == end) {
+            break;
+        }
+        cuts.push_back(p);
+    }
+    cuts.push_back(end);
+    return cuts;
+}
+
+}
+
+struct Lexer::Chunk {
+    const char *begin, *end;
+    std::vector<Token> tokens;
+
+    // where lexing stopped, with lines counted from the start of the chunk
+    int end_line, end_col;
+
+    // a syntax error (with a chunk-relative location) or other exception
+    // that stopped lexing
+    bool has_syntax_error;
+    int error_line, error_col;
+    std::string error_msg;
+    std::exception_ptr other_error;
+};
+
 ////////////////////////////////////////////////////////////////////////
 // Lexer implementation
 ////////////////////////////////////////////////////////////////////////
 
 Lexer::Lexer(FILE *in, const std::string &filename)
-        : m_in(in), m_filename(filename), m_line(1), m_col(1), m_eof(false) {
+        : m_in(in), m_src(new SourceBuffer(in)), m_lookahead_head(0), m_lookahead_count(0),
+          m_file(Location::register_file(filename)), m_line(1), m_col(1), m_prev_line(1), m_prev_col(1),
+          m_mode(MODE_DIRECT), m_queue(nullptr), m_producer_done(false), m_stop(false), m_next_token(0) {
+    m_pos = m_src->begin();
+    m_end = m_src->end();
+}
+
+// Private constructor for a lexer that scans part of another lexer's
+// source buffer.
+Lexer::Lexer(const std::shared_ptr<SourceBuffer> &src, FileId file, const char *begin, const char *end)
+        : m_in(nullptr), m_src(src), m_pos(begin), m_end(end), m_lookahead_head(0), m_lookahead_count(0),
+          m_file(file), m_line(1), m_col(1), m_prev_line(1), m_prev_col(1), m_mode(MODE_DIRECT),
+          m_queue(nullptr), m_producer_done(false), m_stop(false), m_next_token(0) {
+}
+
+Lexer::Lexer(const SourceSpan &span)
+        : m_in(nullptr), m_src(span.src), m_pos(span.begin), m_end(span.end), m_lookahead_head(0),
+          m_lookahead_count(0), m_file(span.file), m_line(span.line), m_col(span.col),
+          m_prev_line(span.line), m_prev_col(span.col), m_mode(MODE_DIRECT), m_queue(nullptr),
+          m_producer_done(false), m_stop(false), m_next_token(0) {
 }
 
 Lexer::~Lexer() {
-    // delete any cached lookahead tokens
-    for (auto i = m_lookahead.begin(); i != m_lookahead.end(); ++i) {
-        delete *i;
+    if (m_mode == MODE_PIPELINED) {
+        // the producer may be waiting for room in the queue
+        m_stop.store(true);
+        m_producer.join();
+        delete m_queue;
+    }
+    if (m_in != nullptr) {
+        fclose(m_in);
+    }
+}
+
+void Lexer::start_pipeline() {
+    assert(m_mode == MODE_DIRECT && m_lookahead_count == 0);
+    m_queue = new SpscQueue<Token>(PIPELINE_CAPACITY);
+    m_mode = MODE_PIPELINED;
+    m_producer = std::thread(&Lexer::produce, this);
+}
+
+void Lexer::lex_parallel(int num_threads) {
+    assert(m_mode == MODE_DIRECT && m_lookahead_count == 0);
+    if (num_threads < 2 || size_t(m_end - m_pos) < MIN_PARALLEL_SIZE) {
+        return;
+    }
+
+    std::vector<const char *> cuts = split_at_lines(m_pos, m_end, num_threads * CHUNKS_PER_THREAD);
+    std::vector<Chunk> chunks(cuts.size() - 1);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        chunks[i].begin = cuts[i];
+        chunks[i].end = cuts[i + 1];
+    }
+
+    // each thread (including this one) takes the next unclaimed chunk
+    std::atomic<size_t> next_chunk(0);
+    auto worker = [&]() {
+        for (size_t i; (i = next_chunk.fetch_add(1)) < chunks.size();) {
+            lex_chunk(chunks[i]);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 1; i < num_threads && size_t(i) < chunks.size(); i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto i = pool.begin(); i != pool.end(); ++i) {
+        i->join();
+    }
+
+    // Concatenate the token arrays. Every chunk but the first starts
+    // just after a newline, so only line numbers need to be rebased.
+    size_t total = 0;
+    for (auto i = chunks.begin(); i != chunks.end(); ++i) {
+        total += i->tokens.size();
     }
-    fclose(m_in);
+    m_tokens.reserve(total);
+
+    int line_base = m_line - 1;
+    for (auto i = chunks.begin(); i != chunks.end(); ++i) {
+        for (auto j = i->tokens.begin(); j != i->tokens.end(); ++j) {
+            Token tok = *j;
+            tok.line += uint32_t(line_base);
+            m_tokens.push_back(tok);
+        }
+        if (i->has_syntax_error) {
+            Location loc(m_file, i->error_line + line_base, i->error_col);
+            m_prelex_error = std::make_exception_ptr(SyntaxError(loc, i->error_msg));
+        } else if (i->other_error) {
+            m_prelex_error = i->other_error;
+        }
+
+        m_line = i->end_line + line_base;
+        m_col = i->end_col;
+        if (m_prelex_error) {
+            // the tokens after an error would never be reached
+            break;
+        }
+        line_base += i->end_line - 1;
+    }
+
+    m_pos = m_end;
+    m_mode = MODE_PRELEXED;
 }
 
-Node *Lexer::next() {
+// Lex one chunk for lex_parallel(). Runs on a worker thread.
+void Lexer::lex_chunk(Chunk &chunk) {
+    Lexer sub(m_src, m_file, chunk.begin, chunk.end);
+    chunk.tokens.reserve(size_t(chunk.end - chunk.begin) / 4);
+    chunk.has_syntax_error = false;
+    try {
+        Token tok;
+        while (sub.read_token(tok)) {
+            chunk.tokens.push_back(tok);
+        }
+    } catch (SyntaxError &ex) {
+        chunk.has_syntax_error = true;
+        chunk.error_line = ex.get_loc().get_line();
+        chunk.error_col = ex.get_loc().get_col();
+        chunk.error_msg = ex.what();
+    } catch (...) {
+        chunk.other_error = std::current_exception();
+    }
+    chunk.end_line = sub.m_line;
+    chunk.end_col = sub.m_col;
+}
+
+Token Lexer::next() {
     fill(1);
-    if (m_lookahead.empty()) {
+    if (m_lookahead_count == 0) {
         SyntaxError::raise(get_current_loc(), "Unexpected end of input");
     }
-    Node *tok = m_lookahead.front();
-    m_lookahead.pop_front();
+    Token tok = m_lookahead[m_lookahead_head];
+    m_lookahead_head = (m_lookahead_head + 1) % LOOKAHEAD_CAPACITY;
+    m_lookahead_count--;
     return tok;
 }
 
-Node *Lexer::peek(int how_many) {
+const Token *Lexer::peek(int how_many) {
+    assert(how_many <= LOOKAHEAD_CAPACITY);
+
     // try to get as many lookahead tokens as required
     fill(how_many);
 
     // if there aren't enough lookahead tokens,
     // then the input ended before the token we want
-    if (int(m_lookahead.size()) < how_many) {
+    if (m_lookahead_count < how_many) {
         return nullptr;
     }
 
-    // return the pointer to the Node representing the token
-    return m_lookahead.at(how_many - 1);
+    return &m_lookahead[(m_lookahead_head + how_many - 1) % LOOKAHEAD_CAPACITY];
+}
+
+std::string Lexer::get_str(const Token &tok) const {
+    const char *start = m_src->begin() + tok.offset;
+    if (tok.get_kind() == TOK_STRING) {
+        // strip the quotes
+        return decode_string(start + 1, start + tok.length - 1);
+    }
+    return std::string(start, tok.length);
+}
+
+Location Lexer::get_loc(const Token &tok) const {
+    return Location(m_file, tok.get_line(), tok.get_col());
+}
+
+SourceSpan Lexer::get_span(const Token &after) const {
+    SourceSpan span;
+    span.src = m_src;
+    span.file = m_file;
+    span.begin = m_src->begin() + after.offset + after.length;
+    span.end = m_end;
+    // assumes the token before the span is on one line (e.g. a brace)
+    span.line = after.get_line();
+    span.col = after.get_col() + int(after.length);
+    return span;
 }
 
 Location Lexer::get_current_loc() const {
-    return Location(m_filename, m_line, m_col);
+    return Location(m_file, m_line, m_col);
 }
 
-// Read the next character of input, returning -1 (and setting m_eof to true)
+// Read the next character of input, returning -1
 // if the end of input has been reached.
 int Lexer::read() {
-    if (m_eof) {
+    if (m_pos == m_end) {
         return -1;
     }
-    int c = fgetc(m_in);
-    if (c < 0) {
-        m_eof = true;
-    } else if (c == '\n') {
+    int c = (unsigned char) *m_pos++;
+    m_prev_line = m_line;
+    m_prev_col = m_col;
+    if (c == '\n') {
         m_col = 1;
         m_line++;
     } else {
@@ -72,130 +308,221 @@ int Lexer::read() {
 // "Unread" a character.  Useful for when reading a character indicates
 // that the current token has ended and the next one has begun.
 void Lexer::unread(int c) {
-    ungetc(c, m_in);
-    m_col--;
+    if (c < 0) {
+        return;
+    }
+    // only the most recently read character can be pushed back
+    assert(m_pos > m_src->begin() && (unsigned char) m_pos[-1] == c);
+    m_pos--;
+    m_line = m_prev_line;
+    m_col = m_prev_col;
+}
+
+// Move the read position forward to p (which must not be before the
+// current position), updating the line and column to match.
+void Lexer::advance_to(const char *p) {
+    assert(p >= m_pos && p <= m_end);
+    for (const char *nl = m_pos; (nl = static_cast<const char *>(memchr(nl, '\n', p - nl))) != nullptr; nl++) {
+        m_line++;
+        m_col = 1 - int(nl + 1 - m_pos);
+    }
+    m_col += int(p - m_pos);
+    m_pos = p;
 }
 
 void Lexer::fill(int how_many) {
     assert(how_many > 0);
-    while (!m_eof && int(m_lookahead.size()) < how_many) {
-        Node *tok = read_token();
+    Token tok;
+    while (m_lookahead_count < how_many && next_token(tok)) {
+        m_lookahead[(m_lookahead_head + m_lookahead_count) % LOOKAHEAD_CAPACITY] = tok;
+        m_lookahead_count++;
+    }
+}
 
-        if (tok != nullptr) {
-            m_lookahead.push_back(tok);
+// Get the next token from the input, either by scanning it directly
+// or from the producer thread. Returns false at the end of input.
+bool Lexer::next_token(Token &tok) {
+    switch (m_mode) {
+        case MODE_PIPELINED:
+            return pop_token(tok);
+        case MODE_PRELEXED:
+            return take_prelexed(tok);
+        default:
+            return read_token(tok);
+    }
+}
+
+// Body of the producer thread in pipelined mode.
+void Lexer::produce() {
+    try {
+        Token tok;
+        while (read_token(tok)) {
+            while (!m_queue->try_push(tok)) {
+                if (m_stop.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
         }
+    } catch (...) {
+        // handed to the parser once it has consumed the tokens before the error
+        m_producer_error = std::current_exception();
     }
+    // publishes m_producer_error and the final line/column
+    m_producer_done.store(true, std::memory_order_release);
 }
 
+// Consumer side of pipelined mode: wait for the next token from the
+// producer thread. Returns false at the end of input, and rethrows any
+// error the producer stopped at.
+bool Lexer::pop_token(Token &tok) {
+    for (;;) {
+        if (m_queue->try_pop(tok)) {
+            return true;
+        }
+        if (m_producer_done.load(std::memory_order_acquire)) {
+            // the producer may have pushed its last tokens just before finishing
+            if (m_queue->try_pop(tok)) {
+                return true;
+            }
+            if (m_producer_error) {
+                std::rethrow_exception(m_producer_error);
+            }
+            return false;
+        }
+        std::this_thread::yield();
+    }
+}
 
-Node *Lexer::read_token() {
+// Prelexed mode: take the next token from m_tokens.
+bool Lexer::take_prelexed(Token &tok) {
+    if (m_next_token < m_tokens.size()) {
+        tok = m_tokens[m_next_token++];
+        return true;
+    }
+    if (m_prelex_error) {
+        std::rethrow_exception(m_prelex_error);
+    }
+    return false;
+}
+
+// Scan the next token into tok. Returns false at the end of input.
+bool Lexer::read_token(Token &tok) {
     int c, line = -1, col = -1;
 
     // skip whitespace characters until a non-whitespace character is read
-    for (;;) {
-        line = m_line;
-        col = m_col;
-        c = read();
-        if (c < 0 || !isspace(c)) {
-            break;
-        }
-    }
+    advance_to(scan::skip_space(m_pos, m_end));
+    line = m_line;
+    col = m_col;
+    const char *start = m_pos;
+    c = read();
 
     if (c < 0) {
         // reached end of file
-        return nullptr;
+        return false;
     }
 
-    std::string lexeme;
-    lexeme.push_back(char(c));
     if (isalpha(c)) {
-        Node *tok = read_continued_token(TOK_IDENTIFIER, lexeme, line, col, isalnum);
-        std::string word = tok->get_str();
-        if (word == "var") {
-            tok->set_tag(TOK_VAR);
-        } else if (word == "function") {
-            tok->set_tag(TOK_FN);
-        } else if (word == "if") {
-            tok->set_tag(TOK_IF);
-        } else if (word == "else") {
-            tok->set_tag(TOK_ELSE);
-        } else if (word == "while") {
-            tok->set_tag(TOK_WHILE);
+        tok = read_continued_token(TOK_IDENTIFIER, start, line, col, scan::skip_alnum);
+        TokenKind kind = keyword::lookup(start, tok.length, TOK_IDENTIFIER);
+        if (kind != TOK_IDENTIFIER) {
+            tok = token_create(kind, start, line, col);
+        } else {
+            tok.sym = intern(start, tok.length);
         }
-        return tok;
+        return true;
     } else if (isdigit(c)) {
-        return read_continued_token(TOK_INTEGER_LITERAL, lexeme, line, col, isdigit);
-    } else {
-        switch (c) {
-            case '+':
-                return token_create(TOK_PLUS, lexeme, line, col);
-            case '-':
-                return token_create(TOK_MINUS, lexeme, line, col);
-            case '*':
-                return token_create(TOK_TIMES, lexeme, line, col);
-            case '/':
-                return token_create(TOK_DIVIDE, lexeme, line, col);
-            case '(':
-                return token_create(TOK_LPAREN, lexeme, line, col);
-            case ')':
-                return token_create(TOK_RPAREN, lexeme, line, col);
-            case '{':
-                return token_create(TOK_LBRACE, lexeme, line, col);
-            case '}':
-                return token_create(TOK_RBRACE, lexeme, line, col);
-            case ',':
-                return token_create(TOK_COMMA, lexeme, line, col);
-            case ';':
-                return token_create(TOK_SEMICOLON, lexeme, line, col);
-            case '=':
-                return read_multi_equal(lexeme, line, col);
-            case '<':
-                return read_multi_less(lexeme, line, col);
-            case '>':
-                return read_multi_greater(lexeme, line, col);
-            case '|':
-                return read_continued_token(TOK_OR, lexeme, line, col, ispunct);
-            case '&':
-                return read_continued_token(TOK_AND, lexeme, line, col, ispunct);
-            case '!':
-                return read_continued_token(TOK_NOTEQUAL, lexeme, line, col, ispunct);
-            case '"':
-                return read_multi_string(lexeme, line, col);
-            default:
-                SyntaxError::raise(get_current_loc(), "Unrecognized character '%c'", c);
-        }
+        tok = read_continued_token(TOK_INTEGER_LITERAL, start, line, col, scan::skip_digits);
+        return true;
     }
+
+    switch (c) {
+        case '+':
+            tok = token_create(TOK_PLUS, start, line, col);
+            break;
+        case '-':
+            tok = token_create(TOK_MINUS, start, line, col);
+            break;
+        case '*':
+            tok = token_create(TOK_TIMES, start, line, col);
+            break;
+        case '/':
+            tok = token_create(TOK_DIVIDE, start, line, col);
+            break;
+        case '(':
+            tok = token_create(TOK_LPAREN, start, line, col);
+            break;
+        case ')':
+            tok = token_create(TOK_RPAREN, start, line, col);
+            break;
+        case '{':
+            tok = token_create(TOK_LBRACE, start, line, col);
+            break;
+        case '}':
+            tok = token_create(TOK_RBRACE, start, line, col);
+            break;
+        case ',':
+            tok = token_create(TOK_COMMA, start, line, col);
+            break;
+        case ';':
+            tok = token_create(TOK_SEMICOLON, start, line, col);
+            break;
+        case '=':
+            tok = read_multi_equal(start, line, col);
+            break;
+        case '<':
+            tok = read_multi_less(start, line, col);
+            break;
+        case '>':
+            tok = read_multi_greater(start, line, col);
+            break;
+        case '|':
+            tok = read_continued_token(TOK_OR, start, line, col, scan::skip_punct);
+            break;
+        case '&':
+            tok = read_continued_token(TOK_AND, start, line, col, scan::skip_punct);
+            break;
+        case '!':
+            tok = read_continued_token(TOK_NOTEQUAL, start, line, col, scan::skip_punct);
+            break;
+        case '"':
+            tok = read_multi_string(start, line, col);
+            break;
+        default:
+            SyntaxError::raise(get_current_loc(), "Unrecognized character '%c'", c);
+    }
+    return true;
 }
 
-// Helper function to create a Node object to represent a token.
-Node *Lexer::token_create(enum TokenKind kind, const std::string &lexeme, int line, int col) {
-    Node *token = new Node(kind, lexeme);
-    Location source_info(m_filename, line, col);
-    token->set_loc(source_info);
-    return token;
+// Get the Symbol for an identifier, checking this lexer's own
+// cache before the global symbol table.
+Symbol Lexer::intern(const char *start, size_t len) {
+    std::string_view name(start, len);
+    auto i = m_symbols.find(name);
+    if (i != m_symbols.end()) {
+        return i->second;
+    }
+    Symbol sym = symtab::intern(start, len);
+    m_symbols.insert({name, sym});
+    return sym;
+}
+
+// Helper function to create a token whose lexeme runs from start
+// to the current read position.
+Token Lexer::token_create(enum TokenKind kind, const char *start, int line, int col) {
+    return Token::make(kind, uint32_t(start - m_src->begin()), uint32_t(m_pos - start), line, col);
 }
 
 // Read the continuation of a (possibly) multi-character token, such as
-// an identifier or integer literal.  pred is a pointer to a predicate
-// function to determine which characters are valid continuations.
-Node *
-Lexer::read_continued_token(enum TokenKind kind, const std::string &lexeme_start, int line, int col, int (*pred)(int)) {
-    std::string lexeme(lexeme_start);
-    for (;;) {
-        int c = read();
-        if (c >= 0 && pred(c)) {
-            // token has finished
-            lexeme.push_back(char(c));
-        } else {
-            if (c >= 0) {
-                unread(c);
-            }
-            return token_create(kind, lexeme, line, col);
-        }
-    }
+// an identifier or integer literal.  skip is a pointer to a scanning
+// function (from scan.h) that finds the end of the valid continuation.
+Token Lexer::read_continued_token(enum TokenKind kind, const char *start, int line, int col,
+                                  const char *(*skip)(const char *, const char *)) {
+    advance_to(skip(m_pos, m_end));
+    return token_create(kind, start, line, col);
 }
 
-Node *Lexer::read_multi_equal(const std::string &lexeme, int line, int col) {
+Token Lexer::read_multi_equal(const char *start, int line, int col) {
     enum TokenKind kind;
 
     int next_c = read();
@@ -209,10 +536,10 @@ Node *Lexer::read_multi_equal(const std::string &lexeme, int line, int col) {
         unread(next_c);
         kind = TOK_ASSIGN;
     }
-    return token_create(kind, lexeme, line, col);
+    return token_create(kind, start, line, col);
 }
 
-Node *Lexer::read_multi_less(const std::string &lexeme, int line, int col) {
+Token Lexer::read_multi_less(const char *start, int line, int col) {
     enum TokenKind kind;
 
     int next_c = read();
@@ -226,10 +553,10 @@ Node *Lexer::read_multi_less(const std::string &lexeme, int line, int col) {
         unread(next_c);
         kind = TOK_LESS;
     }
-    return token_create(kind, lexeme, line, col);
+    return token_create(kind, start, line, col);
 }
 
-Node *Lexer::read_multi_greater(const std::string &lexeme, int line, int col) {
+Token Lexer::read_multi_greater(const char *start, int line, int col) {
     enum TokenKind kind;
 
     int next_c = read();
@@ -243,36 +570,70 @@ Node *Lexer::read_multi_greater(const std::string &lexeme, int line, int col) {
         unread(next_c);
         kind = TOK_GREATER;
     }
-    return token_create(kind, lexeme, line, col);
+    return token_create(kind, start, line, col);
 }
 
-Node *Lexer::read_multi_string(const std::string &lexeme, int line, int col) {
-    int next_c = read();
+// Find the end of a string literal. The token covers the literal
+// including its quotes; escapes are decoded later, by get_str.
+Token Lexer::read_multi_string(const char *start, int line, int col) {
+    for (;;) {
+        // skip the run of plain characters up to the next quote or escape
+        advance_to(scan::find_quote_or_escape(m_pos, m_end));
+
+        int next_c = read();
+        if (next_c < 0) {
+            SyntaxError::raise(Location(m_file, line, col), "Unterminated string literal");
+        } else if (next_c == '"') {
+            return token_create(TOK_STRING, start, line, col);
+        }
+
+        // next_c is a backslash: an escaped quote doesn't end the literal
+        if (m_pos != m_end && *m_pos == '"') {
+            read();
+        }
+    }
+}
+
+// Decode the body of a string literal (between its quotes).
+std::string Lexer::decode_string(const char *p, const char *end) {
     std::string word;
-    while (next_c != '"') {
-        if (next_c == '\\') {
-            int next_next = read();
-            switch (next_next) {
+    while (p != end) {
+        const char *stop = scan::find_quote_or_escape(p, end);
+        word.append(p, stop);
+        p = stop;
+        if (p == end) {
+            break;
+        }
+
+        // *p is a backslash
+        p++;
+        char c = '\\';
+        if (p != end) {
+            switch (*p) {
                 case '"':
-                    next_c = '\"';
+                    c = '"';
+                    p++;
                     break;
                 case 'n':
-                    next_c = '\n';
+                    c = '\n';
+                    p++;
                     break;
                 case 'r':
-                    next_c = '\r';
+                    c = '\r';
+                    p++;
                     break;
                 case 't':
-                    next_c = '\t';
+                    c = '\t';
+                    p++;
                     break;
                 default:
-                    unread(next_next);
+                    // unknown escape: keep the backslash as-is
+                    break;
             }
         }
-        word.push_back(next_c);
-        next_c = read();
+        word.push_back(c);
     }
-    return token_create(TOK_STRING, word, line, col);
+    return word;
 }
 
 std::string Lexer::node_tag_to_string(int tag) {
@@ -332,6 +693,8 @@ std::string Lexer::node_tag_to_string(int tag) {
             return "SEMI";
         case TOK_COMMA:
             return "COMMA";
+        case TOK_IMPORT:
+            return "IMPORT";
         default:
             return "";
     }
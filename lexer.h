@@ -1,61 +1,163 @@
 #ifndef LEXER_H
 #define LEXER_H
 
-#include <deque>
+#include <atomic>
 #include <cstdio>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "token.h"
-#include "node.h"
+#include "location.h"
+#include "source_buffer.h"
+#include "spsc_queue.h"
+
+// A piece of the input that can be lexed again later, e.g. a function
+// body whose parsing was deferred. Holding a span keeps the source
+// buffer alive after the Lexer that produced it is gone.
+struct SourceSpan {
+    std::shared_ptr<SourceBuffer> src;
+    FileId file;
+    const char *begin, *end;
+    int line, col; // position of begin
+};
 
 class Lexer {
 private:
+    // lookahead tokens are kept in a small ring buffer
+    static const int LOOKAHEAD_CAPACITY = 8;
+
+    // tokens the producer thread may get ahead of the parser by
+    static const int PIPELINE_CAPACITY = 4096;
+
+    // where next_token() gets tokens from
+    enum Mode {
+        MODE_DIRECT,    // scan on demand
+        MODE_PIPELINED, // from the producer thread
+        MODE_PRELEXED,  // from m_tokens, filled by lex_parallel()
+    };
+
+    // a piece of the input lexed by one worker in lex_parallel()
+    struct Chunk;
+
     FILE *m_in;
-    std::deque<Node *> m_lookahead;
-    std::string m_filename;
+    std::shared_ptr<SourceBuffer> m_src;
+    const char *m_pos, *m_end;
+    Token m_lookahead[LOOKAHEAD_CAPACITY];
+    int m_lookahead_head, m_lookahead_count;
+    FileId m_file;
     int m_line, m_col;
-    bool m_eof;
+    int m_prev_line, m_prev_col;
+    Mode m_mode;
+
+    // identifiers already interned by this lexer, so that repeated
+    // names don't go to the (shared, locked) global symbol table
+    std::unordered_map<std::string_view, Symbol> m_symbols;
+
+    // pipelined mode: tokens are scanned on m_producer and handed
+    // over through m_queue
+    SpscQueue<Token> *m_queue;
+    std::thread m_producer;
+    std::atomic<bool> m_producer_done, m_stop;
+    std::exception_ptr m_producer_error;
+
+    // prelexed mode: the whole token stream, and the error (if any)
+    // that stopped lexing after the last token
+    std::vector<Token> m_tokens;
+    size_t m_next_token;
+    std::exception_ptr m_prelex_error;
 
 public:
     Lexer(FILE *in, const std::string &filename);
 
+    // Lex a span previously returned by get_span().
+    explicit Lexer(const SourceSpan &span);
+
     ~Lexer();
 
+    // Start scanning on a separate thread, so that lexing overlaps
+    // with parsing. Must be called before the first token is requested.
+    // Errors found by the lexer are still raised by next()/peek()
+    // when the parser reaches them.
+    void start_pipeline();
+
+    // Lex the whole input up front, splitting it into chunks that are
+    // lexed concurrently on up to num_threads threads. Must be called
+    // before the first token is requested. Small inputs are left to be
+    // lexed on demand. As in pipelined mode, lexical errors are raised
+    // when the parser reaches them.
+    void lex_parallel(int num_threads);
+
     // Consume the next token.
     // Throws SyntaxError if the input ends before
     // one token can be read.
-    Node *next();
+    Token next();
 
     // Look ahead and return a pointer to a future token
-    // without consuming it. The how_far parameter indicates
-    // how many tokens to look ahead (1 means return the
-    // next token, 2 means the token after the next token,
-    // etc.)
-    Node *peek(int how_far = 1);
+    // without consuming it, or nullptr if the input ends first.
+    // The how_far parameter indicates how many tokens to look
+    // ahead (1 means return the next token, 2 means the token
+    // after the next token, etc.) and may not exceed
+    // LOOKAHEAD_CAPACITY. The pointer is only valid until the
+    // next call to next().
+    const Token *peek(int how_far = 1);
+
+    // Get the text of a token. For string literals this is the
+    // value of the literal, with quotes removed and escapes decoded.
+    std::string get_str(const Token &tok) const;
+
+    Location get_loc(const Token &tok) const;
+
+    // Get the span of input after a token, up to the end of the
+    // input. The token must not contain a newline.
+    SourceSpan get_span(const Token &after) const;
 
     Location get_current_loc() const;
 
     static std::string node_tag_to_string(int tag);
 
 private:
+    Lexer(const std::shared_ptr<SourceBuffer> &src, FileId file, const char *begin, const char *end);
+
     int read();
 
     void unread(int c);
 
+    void advance_to(const char *p);
+
     void fill(int how_many);
 
-    Node *read_token();
+    bool next_token(Token &tok);
+
+    bool read_token(Token &tok);
+
+    void produce();
+
+    bool pop_token(Token &tok);
+
+    bool take_prelexed(Token &tok);
+
+    void lex_chunk(Chunk &chunk);
+
+    Symbol intern(const char *start, size_t len);
+
+    Token token_create(enum TokenKind kind, const char *start, int line, int col);
 
-    Node *token_create(enum TokenKind kind, const std::string &lexeme, int line, int col);
+    Token read_continued_token(enum TokenKind kind, const char *start, int line, int col,
+                               const char *(*skip)(const char *, const char *));
 
-    Node *
-    read_continued_token(enum TokenKind kind, const std::string &lexeme_start, int line, int col, int (*pred)(int));
+    Token read_multi_equal(const char *start, int line, int col);
 
-    Node *read_multi_equal(const std::string &lexeme, int line, int col);
+    Token read_multi_less(const char *start, int line, int col);
 
-    Node *read_multi_less(const std::string &lexeme, int line, int col);
+    Token read_multi_greater(const char *start, int line, int col);
 
-    Node *read_multi_greater(const std::string &lexeme, int line, int col);
+    Token read_multi_string(const char *start, int line, int col);
 
-    Node *read_multi_string(const std::string &lexeme, int line, int col);
+    static std::string decode_string(const char *p, const char *end);
 };
 
 #endif // LEXER_H
@@ -18,34 +18,67 @@
 // ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <cassert>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include "location.h"
 
+static_assert(std::is_trivially_copyable<Location>::value, "Location should be cheap to copy");
+
+namespace {
+
+// File names are stored in a deque so that references to them (and
+// the string_view keys that refer to them) stay valid as it grows.
+// Id 0 is the name used for unknown locations.
+struct FileTable {
+  std::mutex lock;
+  std::deque<std::string> names;
+  std::unordered_map<std::string_view, FileId> ids;
+
+  FileTable() {
+    names.emplace_back("<unknown>");
+    ids.insert({std::string_view(names.back()), 0});
+  }
+};
+
+FileTable &file_table() {
+  static FileTable t;
+  return t;
+}
+
+}
+
 Location::Location()
-  : m_srcfile("<unknown>")
+  : m_file(0)
   , m_line(-1)
   , m_col(-1) {
 }
 
 Location::Location(const std::string &srcfile, int line, int col)
-  : m_srcfile(srcfile)
+  : m_file(register_file(srcfile))
   , m_line(line)
   , m_col(col) {
 }
 
-Location::Location(const Location &other)
-  : m_srcfile(other.m_srcfile)
-  , m_line(other.m_line)
-  , m_col(other.m_col) {
-}
-
-Location::~Location() {
+FileId Location::register_file(const std::string &srcfile) {
+  FileTable &t = file_table();
+  std::lock_guard<std::mutex> guard(t.lock);
+  auto i = t.ids.find(std::string_view(srcfile));
+  if (i != t.ids.end()) {
+    return i->second;
+  }
+  FileId file = FileId(t.names.size());
+  t.names.push_back(srcfile);
+  t.ids.insert({std::string_view(t.names.back()), file});
+  return file;
 }
 
-Location &Location::operator=(const Location &rhs) {
-  if (this != &rhs) {
-    m_srcfile = rhs.m_srcfile;
-    m_line = rhs.m_line;
-    m_col = rhs.m_col;
-  }
-  return *this;
+const std::string &Location::get_file_name(FileId file) {
+  FileTable &t = file_table();
+  std::lock_guard<std::mutex> guard(t.lock);
+  assert(file < t.names.size());
+  return t.names[file];
 }
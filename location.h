@@ -21,24 +21,39 @@
 #ifndef LOCATION_H
 #define LOCATION_H
 
+#include <cstdint>
 #include <string>
 
+// Index of a source file name in the registry kept by Location.
+typedef uint32_t FileId;
+
+// A position in a source file. Locations are small, trivially
+// copyable values: the file is referred to by its FileId, and its
+// name is looked up in the registry only when it's needed (e.g. to
+// print an error message). The registry may be used from several
+// threads at once.
 class Location {
 private:
-  std::string m_srcfile;
+  FileId m_file;
   int m_line, m_col;
 
 public:
   Location();
   Location(const std::string &srcfile, int line, int col);
-  Location(const Location &other);
-  ~Location();
+  Location(FileId file, int line, int col)
+    : m_file(file), m_line(line), m_col(col) { }
+
+  // Get the id of a source file name, adding it to the registry
+  // if it hasn't been seen before. Names are never removed.
+  static FileId register_file(const std::string &srcfile);
 
-  Location &operator=(const Location &rhs);
+  // Get the name of a registered source file.
+  static const std::string &get_file_name(FileId file);
 
   bool is_valid() const { return m_line > 0; }
 
-  std::string get_srcfile() const { return m_srcfile; }
+  FileId get_file() const { return m_file; }
+  const std::string &get_srcfile() const { return get_file_name(m_file); }
   int get_line() const { return m_line; }
   int get_col() const { return m_col; }
 
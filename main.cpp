@@ -1,12 +1,19 @@
 #include <cstdio>
+#include <cstring>
 #include <unistd.h> // for getopt
 #include <memory>
+#include <thread>
+#include "arena.h"
 #include "lexer.h"
 #include "parser2.h"
 #include "ast.h"
 #include "exceptions.h"
 #include "treeprint.h"
 #include "interp.h"
+#include "flat_ast.h"
+#include "node.h"
+#include "progcache.h"
+#include "source_buffer.h"
 
 enum {
   PRINT_TOKENS,
@@ -14,12 +21,61 @@ enum {
   EXECUTE,
 };
 
+// Set up how the Lexer gets its tokens
+void start_lexer(Lexer *lexer, bool pipelined, bool parallel) {
+  if (parallel) {
+    lexer->lex_parallel(int(std::thread::hardware_concurrency()));
+  } else if (pipelined) {
+    lexer->start_pipeline();
+  }
+}
+
+// Execute a program using the compiled-program cache in cache_dir:
+// a cached program starts running without being lexed, parsed or
+// analyzed, and any other program is compiled (as with -f) and added
+// to the cache.
+int execute_cached(FILE *in, const char *filename, const char *cache_dir, bool pipelined, bool parallel,
+                   bool verbose) {
+  std::shared_ptr<SourceBuffer> src(new SourceBuffer(in));
+  fclose(in);
+  FileId file = Location::register_file(filename);
+  ProgramCache cache(cache_dir, *src);
+
+  std::unique_ptr<Interpreter> interp;
+  FlatAST *prog = cache.load(file);
+  if (prog != nullptr) {
+    interp.reset(new Interpreter(prog));
+  } else {
+    Lexer *lexer = new Lexer(SourceSpan{src, file, src->begin(), src->end(), 1, 1});
+    start_lexer(lexer, pipelined, parallel);
+    std::unique_ptr<Arena> arena(new Arena);
+    Parser2 parser2(lexer, arena.get());
+    if (parallel) {
+      parser2.set_num_threads(int(std::thread::hardware_concurrency()));
+    }
+    Node *ast = parser2.parse();
+    interp.reset(new Interpreter(ast, arena.release()));
+    interp->set_verbose(verbose);
+    interp->analyze();
+    interp->flatten();
+    cache.store(*interp->get_flat(), file);
+  }
+
+  interp->set_module_cache_dir(cache_dir);
+  Value result = interp->execute();
+  printf("Result: %s\n", result.as_str().c_str());
+  return 0;
+}
+
 // The execute function orchestrates the overall program logic,
 // but could throw an exception if an error occurs
 int execute(int argc, char **argv) {
   // handle command line options
   int mode = EXECUTE, opt;
-  while ((opt = getopt(argc, argv, "lp")) != -1) {
+  bool pipelined = false, parallel = false, lazy = false, streaming = false, flat = false, verbose = false;
+  const char *cache_dir = nullptr;
+  TreePrint::Format format = TreePrint::TEXT;
+  while ((opt = getopt(argc, argv, "lpe:tjzsfc:v")) != -1) {
     switch (opt) {
     case 'l':
       mode = PRINT_TOKENS;
@@ -27,6 +83,48 @@ int execute(int argc, char **argv) {
     case 'p':
       mode = PRINT_AST;
       break;
+    case 'e':
+      // print the AST as text, json, or binary
+      mode = PRINT_AST;
+      if (strcmp(optarg, "text") == 0) {
+        format = TreePrint::TEXT;
+      } else if (strcmp(optarg, "json") == 0) {
+        format = TreePrint::JSON;
+      } else if (strcmp(optarg, "binary") == 0) {
+        format = TreePrint::BINARY;
+      } else {
+        RuntimeError::raise("Unknown AST format: %s", optarg);
+      }
+      break;
+    case 't':
+      // lex on a separate thread
+      pipelined = true;
+      break;
+    case 'j':
+      // lex large inputs in parallel chunks, and parse
+      // function bodies in parallel
+      parallel = true;
+      break;
+    case 'z':
+      // parse function bodies when they are first called
+      lazy = true;
+      break;
+    case 's':
+      // execute each top-level statement as soon as it's parsed
+      streaming = true;
+      break;
+    case 'f':
+      // print or execute a flattened copy of the AST
+      flat = true;
+      break;
+    case 'c':
+      // reuse programs compiled by earlier runs
+      cache_dir = optarg;
+      break;
+    case 'v':
+      // report the code the optimizer removes or inlines
+      verbose = true;
+      break;
     default:
       RuntimeError::raise("Unknown option: %c", opt);
     }
@@ -49,38 +147,74 @@ int execute(int argc, char **argv) {
     in = stdin;
   }
 
+  if (mode == EXECUTE && cache_dir != nullptr && !streaming) {
+    return execute_cached(in, filename, cache_dir, pipelined, parallel, verbose);
+  }
+
   // create the Lexer
   std::unique_ptr<Lexer> lexer(new Lexer(in, filename));
+  start_lexer(lexer.get(), pipelined, parallel);
 
   if (mode == PRINT_TOKENS) {
     // just print the tokens
       bool done = false;
       while (!done) {
-          Node *tok = lexer->peek();
-          if (!tok) {
+          const Token *next_tok = lexer->peek();
+          if (!next_tok) {
               done = true;
           } else {
-              tok = lexer->next();
-              int kind = tok->get_tag();
-              std::string lexeme = tok->get_str();
-              printf("%d:%s:%s\n", kind, lexeme.c_str(), lexer->node_tag_to_string(tok->get_tag()).c_str());
-              delete tok;
+              Token tok = lexer->next();
+              int kind = tok.get_kind();
+              std::string lexeme = lexer->get_str(tok);
+              printf("%d:%s:%s\n", kind, lexeme.c_str(), lexer->node_tag_to_string(kind).c_str());
           }
       }
   } else if (mode == PRINT_AST || mode == EXECUTE) {
-    // Create parser and parse the input
-    std::unique_ptr<Parser2> parser2(new Parser2(lexer.release()));
-    std::unique_ptr<Node> ast(parser2->parse());
+    // Create parser and parse the input; the nodes of the AST
+    // are allocated in the arena
+    std::unique_ptr<Arena> arena(new Arena);
+    std::unique_ptr<Parser2> parser2(new Parser2(lexer.release(), arena.get()));
+    if (parallel) {
+      parser2->set_num_threads(int(std::thread::hardware_concurrency()));
+    }
+    // (the AST printer and FlatAST need function bodies in full)
+    parser2->set_lazy_functions(lazy && mode == EXECUTE && !flat);
+
+    if (mode == EXECUTE && streaming) {
+      // The parsed statements are not kept, so memory use and the
+      // time to the first output don't grow with the program
+      Node *unit = arena->make<Node>(AST_UNIT);
+      Interpreter interp(unit, arena.release());
+      interp.set_verbose(verbose);
+      interp.analyze();
+      if (cache_dir != nullptr) {
+        interp.set_module_cache_dir(cache_dir);
+      }
+      Value result = interp.execute_streaming(parser2.get());
+      printf("Result: %s\n", result.as_str().c_str());
+      return 0;
+    }
+
+    Node *ast = parser2->parse();
 
     if (mode == PRINT_AST) {
-      // Print a text representation of the AST
+      // Print a representation of the AST
       ASTTreePrint tp;
-      tp.print(ast.get());
+      tp.set_format(format);
+      if (flat) {
+        tp.print(FlatAST(ast));
+      } else {
+        tp.print(ast);
+      }
     } else {
       // Execute the program: note that the Interpreter assumes responsibility
-      // for deleting the AST
-      Interpreter interp(ast.release());
+      // for deleting the arena, and with it the AST
+      Interpreter interp(ast, arena.release());
+      interp.set_verbose(verbose);
       interp.analyze();
+      if (flat) {
+        interp.flatten();
+      }
       Value result = interp.execute();
       printf("Result: %s\n", result.as_str().c_str());
     }
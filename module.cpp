@@ -0,0 +1,135 @@
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "arena.h"
+#include "cpputil.h"
+#include "exceptions.h"
+#include "lexer.h"
+#include "parser2.h"
+#include "progcache.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "source_buffer.h"
+#include "module.h"
+
+ModuleLoader::ModuleLoader() {
+}
+
+ModuleLoader::~ModuleLoader() {
+}
+
+void ModuleLoader::set_main(const std::string &filename) {
+    std::string path = resolve("", filename);
+    if (m_modules.find(path) == m_modules.end()) {
+        m_modules[path].reset(new Module{path, nullptr, nullptr, true});
+    }
+}
+
+Module *ModuleLoader::get(const std::string &importer, const std::string &path) {
+    std::string resolved = resolve(importer, path);
+    if (m_modules.find(resolved) == m_modules.end()) {
+        load({resolved});
+    }
+    return m_modules[resolved].get();
+}
+
+std::string ModuleLoader::resolve(const std::string &importer, const std::string &path) {
+    std::string full = path;
+    size_t slash = importer.rfind('/');
+    if (!path.empty() && path[0] != '/' && slash != std::string::npos) {
+        full = importer.substr(0, slash + 1) + path;
+    }
+    // so that each file is loaded once, however it's reached
+    char *real = realpath(full.c_str(), nullptr);
+    if (real != nullptr) {
+        full = real;
+        free(real);
+    }
+    return full;
+}
+
+void ModuleLoader::load(std::vector<std::string> paths) {
+    while (!paths.empty()) {
+        std::vector<Module *> level;
+        for (auto i = paths.begin(); i != paths.end(); ++i) {
+            std::unique_ptr<Module> &module = m_modules[*i];
+            if (!module) {
+                module.reset(new Module{*i, nullptr, nullptr, false});
+                level.push_back(module.get());
+            }
+        }
+
+        // each thread (including this one) takes the next unloaded module
+        std::atomic<size_t> next_module(0);
+        auto worker = [&]() {
+            for (size_t i; (i = next_module.fetch_add(1)) < level.size();) {
+                load_file(level[i], m_cache_dir);
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < std::thread::hardware_concurrency() && i < level.size(); i++) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto i = pool.begin(); i != pool.end(); ++i) {
+            i->join();
+        }
+
+        // the modules these import make up the next level
+        paths.clear();
+        for (auto i = level.begin(); i != level.end(); ++i) {
+            if ((*i)->ast) {
+                find_imports((*i)->ast->get_root(), paths);
+            }
+        }
+    }
+}
+
+// Load one module. Runs on a worker thread.
+void ModuleLoader::load_file(Module *module, const std::string &cache_dir) {
+    FILE *in = fopen(module->path.c_str(), "r");
+    if (!in) {
+        return;
+    }
+    try {
+        std::shared_ptr<SourceBuffer> src;
+        try {
+            src.reset(new SourceBuffer(in));
+        } catch (...) {
+            fclose(in);
+            throw;
+        }
+        fclose(in);
+        FileId file = Location::register_file(module->path);
+
+        std::unique_ptr<ProgramCache> cache;
+        if (!cache_dir.empty()) {
+            cache.reset(new ProgramCache(cache_dir, *src));
+            module->ast.reset(cache->load(file));
+            if (module->ast) {
+                return;
+            }
+        }
+
+        Arena arena;
+        Parser2 parser(new Lexer(SourceSpan{src, file, src->begin(), src->end(), 1, 1}), &arena);
+        Node *root = parser.parse();
+        ScopeResolver().resolve_unit(root);
+        Optimizer(&arena).optimize_unit(root);
+        module->ast.reset(new FlatAST(root));
+        if (cache) {
+            cache->store(*module->ast, file);
+        }
+    } catch (BaseException &) {
+        module->ast.reset();
+        module->error = std::current_exception();
+    } catch (std::exception &ex) {
+        // anything else (such as running out of memory) is reported
+        // like other errors, rather than escaping from import
+        module->ast.reset();
+        module->error = std::make_exception_ptr(
+            RuntimeError(cpputil::format("%s: %s", module->path.c_str(), ex.what())));
+    }
+}
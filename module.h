@@ -0,0 +1,89 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.h"
+#include "flat_ast.h"
+
+// A source file loaded for an import statement. Its top-level
+// statements run, in the global environment, the first time it is
+// imported; importing it again does nothing.
+struct Module {
+    std::string path;             // resolved path, also its file name in Locations
+    std::unique_ptr<FlatAST> ast; // nullptr if the file couldn't be loaded
+    std::exception_ptr error;     // if the file couldn't be lexed or parsed
+    bool imported;                // has started running
+};
+
+// Loads each module once per process and keeps it as long as the
+// program runs (its functions refer to its AST). Modules are parsed
+// and kept as FlatASTs. Given a cache directory, the loader also keeps
+// them in a ProgramCache, so they are only parsed again when they
+// change. A module and everything it imports are loaded together, one
+// level of the import graph at a time, with the files of a level
+// loaded in parallel.
+class ModuleLoader {
+private:
+    std::string m_cache_dir;
+    std::unordered_map<std::string, std::unique_ptr<Module>> m_modules;
+
+    // copy constructor and assignment operator prohibited
+    ModuleLoader(const ModuleLoader &);
+
+    ModuleLoader &operator=(const ModuleLoader &);
+
+public:
+    ModuleLoader();
+
+    ~ModuleLoader();
+
+    void set_cache_dir(const std::string &dir) { m_cache_dir = dir; }
+
+    // Record the file of the main program, which (having already
+    // started running) is never loaded as a module.
+    void set_main(const std::string &filename);
+
+    // Load the modules imported by the top-level statements of a unit.
+    // NodeRef is either Node * or FlatNodeRef.
+    template<typename NodeRef>
+    void preload(NodeRef unit);
+
+    // Get the module an import statement in the file importer refers
+    // to, loading it first if necessary.
+    Module *get(const std::string &importer, const std::string &path);
+
+private:
+    // Get the path of a module, relative to the directory of the
+    // file importing it.
+    static std::string resolve(const std::string &importer, const std::string &path);
+
+    template<typename NodeRef>
+    static void find_imports(NodeRef unit, std::vector<std::string> &paths);
+
+    void load(std::vector<std::string> paths);
+
+    static void load_file(Module *module, const std::string &cache_dir);
+};
+
+template<typename NodeRef>
+void ModuleLoader::preload(NodeRef unit) {
+    std::vector<std::string> paths;
+    find_imports(unit, paths);
+    load(paths);
+}
+
+template<typename NodeRef>
+void ModuleLoader::find_imports(NodeRef unit, std::vector<std::string> &paths) {
+    for (unsigned i = 0; i < unit->get_num_kids(); i++) {
+        NodeRef kid = unit->get_kid(i);
+        if (kid->get_tag() == AST_IMPORT) {
+            paths.push_back(resolve(kid->get_loc().get_srcfile(), std::string(kid->get_str())));
+        }
+    }
+}
+
+#endif // MODULE_H
@@ -18,57 +18,51 @@
 // ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <cstring>
+#include <type_traits>
+#include "arena.h"
 #include "node.h"
 
-// Private constructor, used only by other constructors
-Node::Node(int tag, const std::string &str, const std::vector<Node *> &kids)
-  : m_tag(tag)
-  , m_kids(kids)
-  , m_str(str)
-  , m_loc_was_set_explicitly(false) {
-}
+// lets an Arena free a tree without visiting its nodes
+static_assert(std::is_trivially_destructible<Node>::value, "Node should not need a destructor");
 
-// Private constructor, used only by other constructors
-Node::Node(int tag, const std::string &str, const std::initializer_list<Node *> kids)
+Node::Node(Arena *arena, int tag)
   : m_tag(tag)
-  , m_kids(kids)
-  , m_str(str)
+  , m_sym(NO_SYMBOL)
+  , m_arena(arena)
+  , m_kids(nullptr)
+  , m_num_kids(0)
+  , m_kid_capacity(0)
+  , m_str("")
+  , m_str_len(0)
   , m_loc_was_set_explicitly(false) {
 }
 
-Node::Node(int tag)
-  : Node(tag, "", {}) {
+Node::Node(Arena *arena, int tag, std::string_view str)
+  : Node(arena, tag) {
+  set_str(str);
 }
 
-Node::Node(int tag, std::initializer_list<Node *> kids)
-  : Node(tag, "", kids) {
-  // parent node's location defaults to first kid's location
-  if (!m_kids.empty()) {
-    m_loc = m_kids[0]->get_loc();
-  }
+void Node::set_str(std::string_view str) {
+  m_str = m_arena->copy_string(str.data(), str.size());
+  m_str_len = unsigned(str.size());
 }
 
-Node::Node(int tag, const std::vector<Node *> &kids)
-  : Node(tag, "", kids) {
-  // parent node's location defaults to first kid's location
-  if (!m_kids.empty()) {
-    m_loc = m_kids[0]->get_loc();
-  }
-}
-
-Node::Node(int tag, const std::string &str)
-  : Node(tag, str, {}) {
-}
-
-Node::~Node() {
-  // delete child nodes
-  for (auto i = m_kids.begin(); i != m_kids.end(); ++i) {
-    delete *i;
+// Grow the kid array. The old array is left in the arena.
+void Node::reserve_kids(unsigned capacity) {
+  Node **kids = m_arena->alloc_array<Node *>(capacity);
+  if (m_num_kids > 0) {
+    memcpy(kids, m_kids, m_num_kids * sizeof(Node *));
   }
+  m_kids = kids;
+  m_kid_capacity = capacity;
 }
 
 void Node::append_kid(Node *kid) {
-  m_kids.push_back(kid);
+  if (m_num_kids == m_kid_capacity) {
+    reserve_kids(m_kid_capacity == 0 ? 2 : m_kid_capacity * 2);
+  }
+  m_kids[m_num_kids++] = kid;
   // parent node's location defaults to first kid's location
   if (!m_loc.is_valid()) {
     m_loc = kid->get_loc();
@@ -76,7 +70,12 @@ void Node::append_kid(Node *kid) {
 }
 
 void Node::prepend_kid(Node *kid) {
-  m_kids.insert(m_kids.begin(), kid);
+  if (m_num_kids == m_kid_capacity) {
+    reserve_kids(m_kid_capacity == 0 ? 2 : m_kid_capacity * 2);
+  }
+  memmove(m_kids + 1, m_kids, m_num_kids * sizeof(Node *));
+  m_kids[0] = kid;
+  m_num_kids++;
 
   // Here, we update the parent's location unconditionally
   // (since we generally want the parent's location to match that
@@ -86,3 +85,9 @@ void Node::prepend_kid(Node *kid) {
     m_loc = kid->get_loc();
   }
 }
+
+void Node::remove_kid(unsigned index) {
+  assert(index < m_num_kids);
+  memmove(m_kids + index, m_kids + index + 1, (m_num_kids - index - 1) * sizeof(Node *));
+  m_num_kids--;
+}
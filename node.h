@@ -23,20 +23,28 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cassert>
 #include "location.h"
+#include "symtab.h"
 #include "node_base.h"
 
+class Arena;
+
 // Tree node class, suitable for parse trees and ASTs.
-// Nodes can also be used as tokens returned by a lexer.
-// Note that parent nodes take responsibility for deleting
-// their children, so to delete an entire tree, it is
-// sufficient to delete the root.
+// Nodes are made in an Arena (see Arena::make), which also holds
+// their kid arrays and strings. A whole tree is freed at once along
+// with its Arena, so nodes never delete each other.
 
 class Node : public NodeBase {
 private:
   int m_tag;
-  std::vector<Node *> m_kids;
-  std::string m_str;
+  Symbol m_sym;
+  Arena *m_arena;
+  Node **m_kids;
+  unsigned m_num_kids, m_kid_capacity;
+  const char *m_str;
+  unsigned m_str_len;
   Location m_loc;
   bool m_loc_was_set_explicitly;
 
@@ -44,33 +52,43 @@ private:
   Node(const Node &);
   Node &operator=(const Node &);
 
-  Node(int tag, const std::string &str, const std::vector<Node *> &kids);
-  Node(int tag, const std::string &str, const std::initializer_list<Node *> kids);
+  void reserve_kids(unsigned capacity);
 
 public:
-  typedef std::vector<Node *>::const_iterator const_iterator;
-
-  Node(int tag);
-  Node(int tag, std::initializer_list<Node *> kids);
-  Node(int tag, const std::vector<Node *> &kids);
-  Node(int tag, const std::string &str);
+  typedef Node *const *const_iterator;
 
-  virtual ~Node();
+  Node(Arena *arena, int tag);
+  Node(Arena *arena, int tag, std::string_view str);
 
   int get_tag() const { return m_tag; }
   void set_tag(int tag) { m_tag = tag; }
 
-  std::string get_str() const { return m_str; }
-  void set_str(const std::string &str) { m_str = str; }
+  // for identifiers, the string is the name of the node's Symbol;
+  // either way it lives as long as the node
+  std::string_view get_str() const {
+    return m_sym != NO_SYMBOL ? std::string_view(symtab::get_name(m_sym)) : std::string_view(m_str, m_str_len);
+  }
+  void set_str(std::string_view str);
+
+  Symbol get_sym() const { return m_sym; }
+  void set_sym(Symbol sym) { m_sym = sym; }
+
+  // the arena this node (and anything added to it) is allocated in
+  Arena *get_arena() const { return m_arena; }
+  // Allocate anything added to this node from now on in arena, e.g.
+  // once arena has absorbed the one the node was made in.
+  void set_arena(Arena *arena) { m_arena = arena; }
 
   void append_kid(Node *kid);
   void prepend_kid(Node *kid);
-  unsigned get_num_kids() const { return unsigned(m_kids.size()); }
-  Node *get_kid(unsigned index) const { return m_kids.at(index); }
-  Node *get_last_kid() const { return m_kids.back(); }
+  void remove_kid(unsigned index);
+  unsigned get_num_kids() const { return m_num_kids; }
+  Node *get_kid(unsigned index) const { assert(index < m_num_kids); return m_kids[index]; }
+  Node *get_last_kid() const { assert(m_num_kids > 0); return m_kids[m_num_kids - 1]; }
+  void set_kid(unsigned index, Node *kid) { assert(index < m_num_kids); m_kids[index] = kid; }
 
-  const_iterator cbegin() const { return m_kids.cbegin(); }
-  const_iterator cend() const { return m_kids.cend(); }
+  const_iterator cbegin() const { return m_kids; }
+  const_iterator cend() const { return m_kids + m_num_kids; }
 
   void set_loc(const Location &loc) { m_loc = loc; m_loc_was_set_explicitly = true; }
   const Location &get_loc() const { return m_loc; }
@@ -80,16 +98,16 @@ public:
   template<typename Fn>
   void preorder(Fn fn) {
     fn(this);
-    for (auto i = m_kids.begin(); i != m_kids.end(); ++i) {
-      (*i)->preorder(fn);
+    for (unsigned i = 0; i < m_num_kids; ++i) {
+      m_kids[i]->preorder(fn);
     }
   }
 
   // invoke a function on each child
   template<typename Fn>
   void each_child(Fn fn) const {
-    for (auto i = m_kids.begin(); i != m_kids.end(); ++i) {
-      fn(*i);
+    for (unsigned i = 0; i < m_num_kids; ++i) {
+      fn(m_kids[i]);
     }
   }
 };
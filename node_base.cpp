@@ -20,8 +20,7 @@
 
 #include "node_base.h"
 
-NodeBase::NodeBase() {
-}
-
-NodeBase::~NodeBase() {
+NodeBase::NodeBase()
+  : m_has_int_value(false)
+  , m_int_value(0) {
 }
@@ -21,13 +21,45 @@
 #ifndef NODE_BASE_H
 #define NODE_BASE_H
 
+// What scope resolution (see ScopeResolver) found out about a node.
+struct ScopeInfo {
+  // Where the variable named by an AST_VARREF lives: the frame,
+  // counted outward from the current one, and the slot in that frame.
+  // A slot of GLOBAL means the global frame, where variables are
+  // found by Symbol. A slot of REDECLARED marks the name in a
+  // declaration that repeats one in the same block. For an
+  // AST_INLINE_CALL, the first slot of the current frame used by the
+  // function's variables. For an AST_INVARIANT, the first of its two
+  // slots in the current frame: whether its value is known yet, and
+  // the value. For an AST_WHILE, the first slot of the loop's
+  // AST_INVARIANTs, in the frame its body runs in.
+  int depth, slot;
+  // For an AST_STATEMENT_LIST, the number of slots in the frame it
+  // starts (a function body or a top-level block), or -1 if it runs
+  // in the frame of the code around it. For an AST_WHILE, the number
+  // of slots its AST_INVARIANTs have, or -1 if it has none.
+  int num_slots;
+  // For an AST_VARREF naming a local variable: whether the variable
+  // is known to always hold an int.
+  bool always_int;
+
+  enum { UNRESOLVED = -1, GLOBAL = -2, REDECLARED = -3 };
+
+  ScopeInfo() : depth(0), slot(UNRESOLVED), num_slots(-1), always_int(false) { }
+  ScopeInfo(int depth_, int slot_, int num_slots_ = -1)
+    : depth(depth_), slot(slot_), num_slots(num_slots_), always_int(false) { }
+};
+
 // The Node class will inherit from this type, so you can use it
 // to define any attributes and methods that Node objects should have
 // (constant value, results of semantic analysis, code generation info,
 // etc.)
 class NodeBase {
 private:
-  // fields could go here
+  ScopeInfo m_scope;
+  // for an AST_INT_LITERAL, its value, once worked out (see Optimizer)
+  bool m_has_int_value;
+  int m_int_value;
 
   // copy ctor and assignment operator not supported
   NodeBase(const NodeBase &);
@@ -35,7 +67,17 @@ private:
 
 public:
   NodeBase();
-  virtual ~NodeBase();
+
+  // not virtual: Nodes are destroyed by their Arena, which knows
+  // their exact type
+  ~NodeBase() = default;
+
+  const ScopeInfo &get_scope() const { return m_scope; }
+  void set_scope(const ScopeInfo &scope) { m_scope = scope; }
+
+  bool has_int_value() const { return m_has_int_value; }
+  int get_int_value() const { return m_int_value; }
+  void set_int_value(int val) { m_int_value = val; m_has_int_value = true; }
 };
 
 #endif // NODE_BASE_H
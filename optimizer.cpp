@@ -0,0 +1,1209 @@
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <unordered_set>
+#include "arena.h"
+#include "ast.h"
+#include "node.h"
+#include "optimizer.h"
+
+Optimizer::Optimizer(Arena *arena)
+        : m_arena(arena), m_verbose(false) {
+}
+
+void Optimizer::optimize_unit(Node *unit) {
+    std::vector<unsigned> dead;
+    for (unsigned i = 0; i < unit->get_num_kids(); i++) {
+        Node *stmt = unit->get_kid(i);
+        if (stmt->get_tag() == AST_FUNCTION || stmt->get_tag() == AST_IMPORT) {
+            optimize_top_level(stmt);
+        } else if (optimize_statement(stmt, i + 1 == unit->get_num_kids())) {
+            // (the value of the last statement is the program's result)
+            dead.push_back(i);
+        }
+    }
+    for (size_t i = dead.size(); i-- > 0;) {
+        unit->remove_kid(dead[i]);
+    }
+    for (unsigned i = 0; i < unit->get_num_kids(); i++) {
+        if (unit->get_kid(i)->get_tag() != AST_FUNCTION) {
+            number_values(unit->get_kid(i));
+        }
+    }
+}
+
+void Optimizer::remove_unused_functions(Node *unit) {
+    std::unordered_map<Symbol, std::vector<Node *>> functions;
+    // code that may run
+    std::vector<Node *> pending;
+    for (unsigned i = 0; i < unit->get_num_kids(); i++) {
+        Node *stmt = unit->get_kid(i);
+        switch (stmt->get_tag()) {
+            case AST_FUNCTION:
+                functions[stmt->get_kid(0)->get_sym()].push_back(stmt);
+                break;
+            case AST_IMPORT:
+                return;
+            default:
+                pending.push_back(stmt);
+                break;
+        }
+    }
+
+    // a function can be called if its name is used (not necessarily in
+    // a call: the function may be assigned to a variable)
+    std::unordered_set<Symbol> used;
+    while (!pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        switch (n->get_tag()) {
+            case AST_DEFERRED_BODY:
+                // what it uses isn't known yet
+                return;
+            case AST_VARDEF:
+                // declaring a name doesn't use it
+                continue;
+            case AST_VARREF:
+                if (n->get_scope().slot == ScopeInfo::GLOBAL && used.insert(n->get_sym()).second) {
+                    auto i = functions.find(n->get_sym());
+                    if (i != functions.end()) {
+                        for (Node *fn : i->second) {
+                            pending.push_back(fn->get_kid(2));
+                        }
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+        pending.insert(pending.end(), n->cbegin(), n->cend());
+    }
+
+    for (unsigned i = 0; i < unit->get_num_kids(); i++) {
+        Node *fn = unit->get_kid(i);
+        Node *body = fn->get_tag() == AST_FUNCTION ? fn->get_kid(2) : nullptr;
+        if (body == nullptr || used.count(fn->get_kid(0)->get_sym()) != 0 || body->get_num_kids() == 0) {
+            continue;
+        }
+        report(fn, "removed body of unused function " + std::string(fn->get_kid(0)->get_str()));
+        Node *empty = m_arena->make<Node>(AST_STATEMENT_LIST);
+        empty->set_loc(body->get_loc());
+        empty->set_scope(body->get_scope());
+        fn->set_kid(2, empty);
+    }
+}
+
+void Optimizer::inline_functions(Node *unit) {
+    std::vector<Node *> functions;
+    // the functions that may be inlined, by name
+    std::unordered_map<Symbol, Node *> candidates;
+    std::unordered_set<Symbol> rebound;
+    if (!find_functions(unit, functions, candidates, rebound)) {
+        return;
+    }
+
+    std::vector<Node *> pending;
+    // the candidates each function names
+    std::unordered_map<Node *, std::vector<Symbol>> uses;
+    for (Node *fn : functions) {
+        std::vector<Symbol> &names = uses[fn];
+        pending.push_back(fn->get_kid(2));
+        while (!pending.empty()) {
+            Node *n = pending.back();
+            pending.pop_back();
+            if (n->get_tag() == AST_VARREF && n->get_scope().slot == ScopeInfo::GLOBAL &&
+                candidates.count(n->get_sym()) != 0) {
+                names.push_back(n->get_sym());
+            }
+            pending.insert(pending.end(), n->cbegin(), n->cend());
+        }
+    }
+
+    // A function's calls are inlined once those of the candidates it
+    // names have been, so what is inlined is final. A candidate that
+    // can call itself is never ready, so it isn't inlined; calls in
+    // such functions are inlined last.
+    std::unordered_map<Symbol, Node *> inlinable;
+    std::unordered_set<Symbol> done;
+    for (bool progress = true; progress;) {
+        progress = false;
+        for (size_t i = 0; i < functions.size(); i++) {
+            Node *fn = functions[i];
+            bool ready = true;
+            for (Symbol name : uses[fn]) {
+                ready = ready && done.count(name) != 0;
+            }
+            if (!ready) {
+                continue;
+            }
+            inline_calls(fn->get_kid(2), inlinable);
+            Symbol name = fn->get_kid(0)->get_sym();
+            if (candidates.count(name) != 0) {
+                done.insert(name);
+                unsigned size = 0;
+                pending.push_back(fn->get_kid(2));
+                while (!pending.empty()) {
+                    Node *n = pending.back();
+                    pending.pop_back();
+                    size++;
+                    pending.insert(pending.end(), n->cbegin(), n->cend());
+                }
+                if (size <= MAX_INLINE_SIZE) {
+                    inlinable[name] = fn;
+                }
+            }
+            functions.erase(functions.begin() + long(i--));
+            progress = true;
+        }
+    }
+    for (Node *fn : functions) {
+        inline_calls(fn->get_kid(2), inlinable);
+    }
+    for (unsigned i = 0; i < unit->get_num_kids(); i++) {
+        Node *stmt = unit->get_kid(i);
+        if (stmt->get_tag() != AST_FUNCTION) {
+            inline_calls(stmt, inlinable);
+        }
+    }
+}
+
+// Find the function definitions of a program, and which of them are
+// certain to be what their name refers to whenever code runs: ones
+// defined once, before any statement but a var statement, whose name
+// isn't assigned to or declared as a variable, and which have no
+// repeated parameter (which makes calling them an error). Any other
+// name defined, assigned or declared as a global goes in rebound.
+// Returns false if there is no telling, because the program imports
+// modules or has function bodies still to be parsed.
+bool Optimizer::find_functions(Node *unit, std::vector<Node *> &functions, std::unordered_map<Symbol, Node *> &fixed,
+                               std::unordered_set<Symbol> &rebound) {
+    bool code_ran = false;
+    for (unsigned i = 0; i < unit->get_num_kids(); i++) {
+        Node *stmt = unit->get_kid(i);
+        switch (stmt->get_tag()) {
+            case AST_IMPORT:
+                return false;
+            case AST_FUNCTION: {
+                if (stmt->get_kid(2)->get_tag() == AST_DEFERRED_BODY) {
+                    return false;
+                }
+                functions.push_back(stmt);
+                Symbol name = stmt->get_kid(0)->get_sym();
+                if (code_ran || !fixed.insert({name, stmt}).second) {
+                    rebound.insert(name);
+                }
+                std::unordered_set<Symbol> params;
+                for (unsigned k = 0; k < stmt->get_kid(1)->get_num_kids(); k++) {
+                    if (!params.insert(stmt->get_kid(1)->get_kid(k)->get_sym()).second) {
+                        rebound.insert(name);
+                    }
+                }
+                break;
+            }
+            default:
+                if (stmt->get_kid(0)->get_tag() == AST_VARDEF) {
+                    rebound.insert(stmt->get_kid(0)->get_last_kid()->get_sym());
+                } else {
+                    code_ran = true;
+                }
+                break;
+        }
+    }
+    std::vector<Node *> pending(1, unit);
+    while (!pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        if (n->get_tag() == AST_ASSIGN && n->get_kid(0)->get_scope().slot == ScopeInfo::GLOBAL) {
+            rebound.insert(n->get_kid(0)->get_sym());
+        }
+        pending.insert(pending.end(), n->cbegin(), n->cend());
+    }
+    for (Symbol name : rebound) {
+        fixed.erase(name);
+    }
+    return true;
+}
+
+// Inline the calls of the given functions in a function body or a
+// top-level statement. A call becomes an AST_INLINE_CALL holding the
+// arguments and a copy of the body: it does what a call does, but in
+// the caller's frame, putting the arguments in the slots given to the
+// parameters, with the body's variables in slots after the caller's.
+// Calls at the top level, outside a block, are left alone, since there
+// is no frame for the function's variables.
+void Optimizer::inline_calls(Node *code, const std::unordered_map<Symbol, Node *> &inlinable) {
+    struct Entry {
+        Node *node, *parent;
+        unsigned index;
+        // the function body or top-level block whose frame the code
+        // runs in, if any
+        Node *frame;
+    };
+    std::vector<Entry> pending(1, Entry{code, nullptr, 0, nullptr});
+    while (!pending.empty()) {
+        Entry e = pending.back();
+        pending.pop_back();
+        Node *n = e.node;
+        if (n->get_tag() == AST_STATEMENT_LIST && n->get_scope().num_slots >= 0) {
+            e.frame = n;
+        }
+
+        unsigned num_kids = n->get_num_kids();
+        if (e.frame != nullptr && n->get_tag() == AST_VARREF && num_kids == 1 &&
+            n->get_kid(0)->get_tag() == AST_ARGLIST && n->get_scope().slot == ScopeInfo::GLOBAL) {
+            auto i = inlinable.find(n->get_sym());
+            Node *args = n->get_kid(0);
+            if (i != inlinable.end() && i->second->get_kid(1)->get_num_kids() == args->get_num_kids()) {
+                report(n, "inlined call of " + std::string(n->get_str()));
+                ScopeInfo frame = e.frame->get_scope();
+                Node *call = m_arena->make<Node>(AST_INLINE_CALL, n->get_str());
+                call->set_loc(n->get_loc());
+                call->set_scope(ScopeInfo(0, frame.num_slots));
+                for (unsigned k = 0; k < args->get_num_kids(); k++) {
+                    call->append_kid(args->get_kid(k));
+                }
+                Node *body = i->second->get_kid(2);
+                call->append_kid(copy_body(body, frame.num_slots));
+                frame.num_slots += body->get_scope().num_slots;
+                e.frame->set_scope(frame);
+                e.parent->set_kid(e.index, call);
+                // the arguments may have calls to inline too, but the
+                // body's have been done already
+                n = call;
+                num_kids = args->get_num_kids();
+            }
+        }
+        for (unsigned k = 0; k < num_kids; k++) {
+            pending.push_back(Entry{n->get_kid(k), n, k, e.frame});
+        }
+    }
+}
+
+// Copy a function body for inlining, with its variables moved to the
+// slots from first_slot on. The copy runs in the frame of the code
+// around it.
+Node *Optimizer::copy_body(Node *body, int first_slot) {
+    Node *copy = m_arena->make<Node>(body->get_tag());
+    if (body->get_sym() != NO_SYMBOL) {
+        copy->set_sym(body->get_sym());
+    } else {
+        copy->set_str(body->get_str());
+    }
+    copy->set_loc(body->get_loc());
+    if (body->has_int_value()) {
+        copy->set_int_value(body->get_int_value());
+    }
+
+    ScopeInfo scope = body->get_scope();
+    if ((body->get_tag() == AST_VARREF || body->get_tag() == AST_INLINE_CALL) && scope.slot >= 0) {
+        scope.slot += first_slot;
+    }
+    scope.num_slots = -1;
+    copy->set_scope(scope);
+
+    // (bodies that are inlined are small)
+    for (unsigned i = 0; i < body->get_num_kids(); i++) {
+        copy->append_kid(copy_body(body->get_kid(i), first_slot));
+    }
+    return copy;
+}
+
+void Optimizer::hoist_invariants(Node *unit) {
+    std::vector<Node *> functions;
+    std::unordered_map<Symbol, Node *> fixed;
+    std::unordered_set<Symbol> rebound;
+    if (!find_functions(unit, functions, fixed, rebound)) {
+        return;
+    }
+
+    m_effects.clear();
+    for (const IntrinsicInfo *info = intrinsics; info->name != nullptr; info++) {
+        Symbol name = symtab::intern(info->name);
+        if (fixed.count(name) == 0 && rebound.count(name) == 0) {
+            m_effects[name] = Effect(info->effect);
+        }
+    }
+    // What a function may do depends on the functions it calls, which
+    // may call it: start by assuming none does anything, and raise that
+    // until it holds for every function.
+    for (auto &fn : fixed) {
+        m_effects[fn.first] = EFFECT_NONE;
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto &fn : fixed) {
+            Effect effect = code_effect(fn.second->get_kid(2));
+            if (effect > m_effects[fn.first]) {
+                m_effects[fn.first] = effect;
+                changed = true;
+            }
+        }
+    }
+
+    for (Node *fn : functions) {
+        hoist_in(fn->get_kid(2));
+    }
+    for (unsigned i = 0; i < unit->get_num_kids(); i++) {
+        Node *stmt = unit->get_kid(i);
+        if (stmt->get_tag() != AST_FUNCTION) {
+            hoist_in(stmt);
+        }
+    }
+}
+
+// Hoist the invariants of the while loops in a function body or a
+// top-level statement, outer loops first, so an inner loop can reuse
+// what was found for the loops around it.
+void Optimizer::hoist_in(Node *code) {
+    struct Entry {
+        Node *node;
+        // the function body or top-level block whose frame the code
+        // runs in, if any
+        Node *frame;
+    };
+    std::vector<Entry> pending(1, Entry{code, nullptr});
+    while (!pending.empty()) {
+        Entry e = pending.back();
+        pending.pop_back();
+        Node *n = e.node;
+        if (n->get_tag() == AST_STATEMENT_LIST && n->get_scope().num_slots >= 0) {
+            e.frame = n;
+        }
+        if (n->get_tag() == AST_WHILE) {
+            Node *body = n->get_kid(1);
+            if (e.frame != nullptr) {
+                hoist_loop(n, e.frame, true);
+            } else if (body->get_scope().num_slots >= 0) {
+                // a loop at the top level, whose condition isn't in any
+                // frame, but whose body has one frame for all iterations
+                hoist_loop(n, body, false);
+            }
+        }
+        for (unsigned k = 0; k < n->get_num_kids(); k++) {
+            pending.push_back(Entry{n->get_kid(k), e.frame});
+        }
+    }
+}
+
+// Wrap the largest expressions of a loop that it can't change in
+// AST_INVARIANTs, whose slots are added to the given frame. Those in
+// the condition are left alone unless it runs in that frame. Each
+// AST_INVARIANT has two slots, one saying whether its value is known
+// yet and the other holding it, and the AST_WHILE's slot and num_slots
+// give the range of slots to clear each time the loop starts. The value
+// is worked out when the expression is first reached, not before the
+// loop, so an error in it is still raised when, and where, it is.
+void Optimizer::hoist_loop(Node *loop, Node *frame, bool cond_in_frame) {
+    // the local slots and globals the loop assigns, and the worst its
+    // calls do
+    std::unordered_set<int> slots;
+    find_written_slots(loop, slots);
+    std::unordered_set<Symbol> globals;
+    Effect effect = EFFECT_NONE;
+    std::vector<Node *> pending(1, loop);
+    while (!pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        if (n->get_tag() == AST_ASSIGN && n->get_kid(0)->get_scope().slot == ScopeInfo::GLOBAL) {
+            globals.insert(n->get_kid(0)->get_sym());
+        } else if (n->get_tag() == AST_VARREF) {
+            effect = std::max(effect, ref_effect(n));
+        }
+        pending.insert(pending.end(), n->cbegin(), n->cend());
+    }
+
+    // Find the invariant nodes, kids before parents: literals, the
+    // variables the loop leaves alone, expressions already found to be
+    // invariant by a loop around this one, and operators and calls
+    // that only depend on invariants.
+    struct Entry {
+        Node *node, *parent;
+        unsigned index;
+    };
+    std::vector<Entry> order;
+    if (cond_in_frame) {
+        order.push_back(Entry{loop->get_kid(0), loop, 0});
+    }
+    order.push_back(Entry{loop->get_kid(1), loop, 1});
+    size_t num_roots = order.size();
+    for (size_t i = 0; i < order.size(); i++) {
+        Node *n = order[i].node;
+        if (n->get_tag() != AST_INVARIANT) {
+            for (unsigned k = 0; k < n->get_num_kids(); k++) {
+                order.push_back(Entry{n->get_kid(k), n, k});
+            }
+        }
+    }
+    std::unordered_set<Node *> invariant;
+    for (size_t i = order.size(); i-- > 0;) {
+        Node *n = order[i].node;
+        bool is_invariant = false;
+        switch (n->get_tag()) {
+            case AST_INT_LITERAL:
+            case AST_STRING:
+            case AST_INVARIANT:
+                is_invariant = true;
+                break;
+            case AST_VARREF: {
+                const ScopeInfo &scope = n->get_scope();
+                if (n->get_num_kids() == 0) {
+                    is_invariant = scope.slot >= 0 ? slots.count(scope.slot) == 0 :
+                                   scope.slot == ScopeInfo::GLOBAL && effect != EFFECT_ANY &&
+                                   globals.count(n->get_sym()) == 0;
+                    break;
+                }
+                Effect call = ref_effect(n);
+                if (call == EFFECT_NONE || (call == EFFECT_READS_ARRAYS && effect < EFFECT_WRITES_ARRAYS)) {
+                    Node *args = n->get_kid(0);
+                    is_invariant = true;
+                    for (unsigned k = 0; k < args->get_num_kids(); k++) {
+                        is_invariant = is_invariant && invariant.count(args->get_kid(k)) != 0;
+                    }
+                }
+                break;
+            }
+            case AST_ADD:
+            case AST_SUB:
+            case AST_MULTIPLY:
+            case AST_DIVIDE:
+            case AST_AND:
+            case AST_OR:
+            case AST_LESS:
+            case AST_LESSEQUAL:
+            case AST_GREATER:
+            case AST_GREATEREQUAL:
+            case AST_EQUAL:
+            case AST_NOTEQUAL:
+                is_invariant = true;
+                for (unsigned k = 0; k < n->get_num_kids(); k++) {
+                    is_invariant = is_invariant && invariant.count(n->get_kid(k)) != 0;
+                }
+                break;
+            default:
+                break;
+        }
+        if (is_invariant) {
+            invariant.insert(n);
+        }
+    }
+
+    // wrap the invariant operators and calls whose parent isn't one
+    ScopeInfo frame_scope = frame->get_scope();
+    int first = frame_scope.num_slots;
+    std::vector<Entry> wrap(order.begin(), order.begin() + long(num_roots));
+    while (!wrap.empty()) {
+        Entry e = wrap.back();
+        wrap.pop_back();
+        Node *n = e.node;
+        if (n->get_tag() == AST_INVARIANT) {
+            continue;
+        }
+        bool leaf = n->get_tag() == AST_INT_LITERAL || n->get_tag() == AST_STRING ||
+                    (n->get_tag() == AST_VARREF && n->get_num_kids() == 0);
+        if (invariant.count(n) != 0 && !leaf) {
+            report(n, "computing loop-invariant expression once per loop");
+            Node *cached = m_arena->make<Node>(AST_INVARIANT);
+            cached->set_loc(n->get_loc());
+            cached->set_scope(ScopeInfo(0, frame_scope.num_slots));
+            cached->append_kid(n);
+            e.parent->set_kid(e.index, cached);
+            frame_scope.num_slots += 2;
+            continue;
+        }
+        for (unsigned k = 0; k < n->get_num_kids(); k++) {
+            wrap.push_back(Entry{n->get_kid(k), n, k});
+        }
+    }
+    if (frame_scope.num_slots > first) {
+        frame->set_scope(frame_scope);
+        loop->set_scope(ScopeInfo(0, first, frame_scope.num_slots - first));
+    }
+}
+
+// The worst running a piece of code may do.
+Optimizer::Effect Optimizer::code_effect(Node *code) const {
+    Effect effect = EFFECT_NONE;
+    std::vector<Node *> pending(1, code);
+    while (!pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        if (n->get_tag() == AST_ASSIGN && n->get_kid(0)->get_scope().slot == ScopeInfo::GLOBAL) {
+            return EFFECT_ANY;
+        }
+        if (n->get_tag() == AST_VARREF) {
+            effect = std::max(effect, ref_effect(n));
+        }
+        pending.insert(pending.end(), n->cbegin(), n->cend());
+    }
+    return effect;
+}
+
+// What a variable reference may do: a call does what the function
+// called does, if that is known, and the value of a global may differ
+// from one time to the next (which is as bad as an effect that changes
+// no variable).
+Optimizer::Effect Optimizer::ref_effect(Node *ref) const {
+    bool global = ref->get_scope().slot == ScopeInfo::GLOBAL;
+    if (ref->get_num_kids() == 0 || ref->get_kid(0)->get_tag() != AST_ARGLIST) {
+        return global ? EFFECT_OTHER : EFFECT_NONE;
+    }
+    auto i = m_effects.find(ref->get_sym());
+    return global && i != m_effects.end() ? i->second : EFFECT_ANY;
+}
+
+void Optimizer::optimize_top_level(Node *stmt) {
+    switch (stmt->get_tag()) {
+        case AST_FUNCTION:
+            if (stmt->get_kid(2)->get_tag() != AST_DEFERRED_BODY) {
+                optimize_function(stmt->get_kid(2));
+            }
+            break;
+        case AST_IMPORT:
+            break;
+        default:
+            // each statement's value counts, as it may be the last
+            optimize_statement(stmt, true);
+            number_values(stmt);
+            break;
+    }
+}
+
+void Optimizer::optimize_function(Node *body) {
+    // nothing is known about the parameters
+    m_consts.clear();
+    // the value of the last statement is the function's result
+    optimize_block(body, true);
+    number_values(body);
+}
+
+// Optimize the statements of a block. A local variable assigned at most
+// once is replaced by its value where that is known: it holds 0 from
+// its declaration up to the assignment, and afterwards, if the
+// assignment is a statement of the block declaring the variable and
+// assigns a constant, that constant. Since a variable can only be
+// assigned after its declaration, in its own block, only the
+// statements following the declaration need to be looked at. Globals
+// are left alone, since functions and modules may assign them at any
+// time. A block evaluates to its last statement, so if its value is
+// used, that statement is only ever simplified.
+void Optimizer::optimize_block(Node *list, bool value_used) {
+    // the assignments to locals in each statement, by slot: a local
+    // declared by statement i is assigned by those after i (earlier
+    // ones are to variables of blocks that have ended, which had the
+    // slot before it)
+    std::unordered_map<int, std::vector<std::pair<unsigned, Node *>>> assigns;
+    std::vector<Node *> found;
+    for (unsigned i = 0; i < list->get_num_kids(); i++) {
+        found.clear();
+        find_assigns(list->get_kid(i), found);
+        for (Node *assign : found) {
+            assigns[assign->get_kid(0)->get_scope().slot].push_back({i, assign});
+        }
+    }
+
+    // the locals of this block being tracked, and for each statement
+    // that is the one assignment to one of them, its slot
+    std::vector<int> tracked;
+    std::unordered_map<unsigned, int> tracked_assigns;
+    std::vector<unsigned> dead;
+    for (unsigned i = 0; i < list->get_num_kids(); i++) {
+        Node *stmt = list->get_kid(i);
+        if (optimize_statement(stmt, value_used && i + 1 == list->get_num_kids())) {
+            dead.push_back(i);
+            continue;
+        }
+
+        Node *s = stmt->get_kid(0);
+        auto a = tracked_assigns.find(i);
+        if (a != tracked_assigns.end()) {
+            int val;
+            if (get_constant(s->get_kid(1), val)) {
+                m_consts[a->second] = val;
+            } else {
+                m_consts.erase(a->second);
+            }
+        } else if (s->get_tag() == AST_VARDEF && s->get_last_kid()->get_scope().slot >= 0) {
+            int slot = s->get_last_kid()->get_scope().slot;
+            unsigned num_later = 0;
+            unsigned last = 0;
+            for (const std::pair<unsigned, Node *> &entry : assigns[slot]) {
+                if (entry.first > i) {
+                    num_later++;
+                    last = entry.first;
+                }
+            }
+            // a declaration sets the variable to 0
+            if (num_later == 0) {
+                m_consts[slot] = 0;
+                tracked.push_back(slot);
+            } else if (num_later == 1 && list->get_kid(last)->get_kid(0)->get_tag() == AST_ASSIGN &&
+                       list->get_kid(last)->get_kid(0)->get_kid(0)->get_scope().slot == slot) {
+                m_consts[slot] = 0;
+                tracked.push_back(slot);
+                tracked_assigns[last] = slot;
+            }
+        }
+    }
+
+    // the block's locals go out of scope
+    for (int slot : tracked) {
+        m_consts.erase(slot);
+    }
+
+    for (size_t i = dead.size(); i-- > 0;) {
+        list->remove_kid(dead[i]);
+    }
+}
+
+// Optimize a statement, returning true if it can be removed. If its
+// value is used, it is kept (if, while and var statements evaluate to
+// 0 and may otherwise be replaced by their effect).
+bool Optimizer::optimize_statement(Node *stmt, bool value_used) {
+    Node *s = stmt->get_kid(0);
+    int cond;
+    switch (s->get_tag()) {
+        case AST_VARDEF:
+            return false;
+        case AST_IF:
+            s->set_kid(0, optimize_expression(s->get_kid(0)));
+            if (!value_used && get_constant(s->get_kid(0), cond)) {
+                // the branch taken runs as a block of its own
+                Node *taken = cond != 0 ? s->get_kid(1) : s->get_num_kids() == 3 ? s->get_kid(2) : nullptr;
+                if (taken == nullptr) {
+                    report(stmt, "removed if statement whose condition is always false");
+                    return true;
+                }
+                report(stmt, s->get_num_kids() == 3 || cond == 0 ? "removed branch of if statement that never runs"
+                                                                  : "removed condition of if statement that always runs");
+                stmt->set_kid(0, taken);
+                optimize_block(taken, false);
+                return false;
+            }
+            break;
+        case AST_WHILE:
+            s->set_kid(0, optimize_expression(s->get_kid(0)));
+            if (!value_used && get_constant(s->get_kid(0), cond) && cond == 0) {
+                report(stmt, "removed while loop that never runs");
+                return true;
+            }
+            break;
+        default:
+            stmt->set_kid(0, optimize_expression(s));
+            if (!value_used && has_no_effect(stmt->get_kid(0))) {
+                report(stmt, "removed statement with no effect");
+                return true;
+            }
+            return false;
+    }
+
+    for (unsigned i = 1; i < s->get_num_kids(); i++) {
+        optimize_block(s->get_kid(i), false);
+    }
+    return false;
+}
+
+// Simplify an expression, returning what should replace it (possibly
+// the expression itself, simplified in place).
+Node *Optimizer::optimize_expression(Node *expr) {
+    // expressions can nest deeply, so don't recurse: list the nodes
+    // with each one after its parent, then simplify them in reverse,
+    // so a node's kids are done before it
+    struct Entry {
+        Node *node, *parent;
+        unsigned index;
+    };
+    std::vector<Entry> order(1, Entry{expr, nullptr, 0});
+    for (size_t i = 0; i < order.size(); i++) {
+        Node *n = order[i].node;
+        // the variable an assignment assigns to is left as it is
+        for (unsigned k = n->get_tag() == AST_ASSIGN ? 1 : 0; k < n->get_num_kids(); k++) {
+            order.push_back(Entry{n->get_kid(k), n, k});
+        }
+    }
+
+    for (size_t i = order.size(); i-- > 0;) {
+        Node *simpler = fold(order[i].node);
+        if (simpler != order[i].node) {
+            if (order[i].parent != nullptr) {
+                order[i].parent->set_kid(order[i].index, simpler);
+            } else {
+                expr = simpler;
+            }
+        }
+    }
+    return expr;
+}
+
+// Simplify one node, whose kids have already been simplified.
+Node *Optimizer::fold(Node *expr) {
+    int tag = expr->get_tag();
+    int lhs, rhs;
+    switch (tag) {
+        case AST_INT_LITERAL:
+            // one too large for an int is left for the interpreter
+            // to fail on, if it's evaluated
+            if (!expr->has_int_value() && int_literal_value(expr->get_str(), lhs)) {
+                expr->set_int_value(lhs);
+            }
+            return expr;
+        case AST_VARREF:
+            if (expr->get_num_kids() == 0 && expr->get_scope().depth == 0) {
+                auto i = m_consts.find(expr->get_scope().slot);
+                if (i != m_consts.end()) {
+                    return make_int_literal(i->second, expr);
+                }
+            }
+            return expr;
+        case AST_AND:
+        case AST_OR:
+            if (!get_constant(expr->get_kid(0), lhs)) {
+                return expr;
+            }
+            // short-circuited, so the right operand doesn't matter
+            if (tag == AST_AND ? lhs == 0 : lhs == 1) {
+                return make_int_literal(tag == AST_AND ? 0 : 1, expr);
+            }
+            if (!get_constant(expr->get_kid(1), rhs)) {
+                return expr;
+            }
+            if (tag == AST_AND) {
+                return make_int_literal(lhs == 1 && rhs == 1, expr);
+            }
+            return make_int_literal(lhs != 0 || rhs != 0, expr);
+        case AST_ADD:
+        case AST_SUB:
+        case AST_MULTIPLY:
+        case AST_DIVIDE:
+        case AST_LESS:
+        case AST_LESSEQUAL:
+        case AST_GREATER:
+        case AST_GREATEREQUAL:
+        case AST_EQUAL:
+        case AST_NOTEQUAL:
+            if (!get_constant(expr->get_kid(0), lhs) || !get_constant(expr->get_kid(1), rhs)) {
+                return reduce(expr);
+            }
+            break;
+        default:
+            return expr;
+    }
+
+    // arithmetic wraps around, as it does when the interpreter does it
+    switch (tag) {
+        case AST_ADD:
+            return make_int_literal(int(unsigned(lhs) + unsigned(rhs)), expr);
+        case AST_SUB:
+            return make_int_literal(int(unsigned(lhs) - unsigned(rhs)), expr);
+        case AST_MULTIPLY:
+            return make_int_literal(int(unsigned(lhs) * unsigned(rhs)), expr);
+        case AST_DIVIDE:
+            // left to fail at run time
+            if (rhs == 0 || (lhs == INT_MIN && rhs == -1)) {
+                return expr;
+            }
+            return make_int_literal(lhs / rhs, expr);
+        case AST_LESS:
+            return make_int_literal(lhs < rhs, expr);
+        case AST_LESSEQUAL:
+            return make_int_literal(lhs <= rhs, expr);
+        case AST_GREATER:
+            return make_int_literal(lhs > rhs, expr);
+        case AST_GREATEREQUAL:
+            return make_int_literal(lhs >= rhs, expr);
+        case AST_EQUAL:
+            return make_int_literal(lhs == rhs, expr);
+        default:
+            return make_int_literal(lhs != rhs, expr);
+    }
+}
+
+// Simplify an arithmetic operation with one constant operand that
+// leaves the other as it is: x + 0, 0 + x, x - 0, x * 1, 1 * x and
+// x / 1 are x, and x * 0 and 0 * x are 0 if x can't fail. An operand
+// that isn't an int is an error, so x has to be one.
+Node *Optimizer::reduce(Node *expr) {
+    int tag = expr->get_tag();
+    Node *lhs = expr->get_kid(0), *rhs = expr->get_kid(1);
+    int val;
+    if (get_constant(rhs, val) && is_int(lhs)) {
+        if ((val == 0 && (tag == AST_ADD || tag == AST_SUB)) || (val == 1 && (tag == AST_MULTIPLY || tag == AST_DIVIDE))) {
+            return lhs;
+        }
+        if (val == 0 && tag == AST_MULTIPLY && has_no_effect(lhs)) {
+            return rhs;
+        }
+    } else if (get_constant(lhs, val) && is_int(rhs)) {
+        if ((val == 0 && tag == AST_ADD) || (val == 1 && tag == AST_MULTIPLY)) {
+            return rhs;
+        }
+        if (val == 0 && tag == AST_MULTIPLY && has_no_effect(rhs)) {
+            return lhs;
+        }
+    }
+    return expr;
+}
+
+// Reuse the values of repeated operations in the function bodies and
+// blocks of some code, each of which has a frame for the locals that
+// keep the values. Within statements that run one after another, an
+// operation on locals and literals already worked out, with the locals
+// unchanged since, isn't worked out again: the first one is made to
+// also assign its value to a local of its own, added to the frame, and
+// the others are replaced by that local.
+void Optimizer::number_values(Node *code) {
+    std::vector<Node *> pending(1, code);
+    while (!pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        if (n->get_tag() == AST_STATEMENT_LIST && n->get_scope().num_slots >= 0) {
+            m_numbers.clear();
+            m_versions.clear();
+            m_occurrences.clear();
+            number_block(n, n, {});
+            continue;
+        }
+        pending.insert(pending.end(), n->cbegin(), n->cend());
+    }
+}
+
+// Number the statements of a block in the order they run. The
+// expressions in available have already been worked out when the block
+// starts; those found in it are only available within it, since it may
+// not run, or may run again (so a loop's condition and body are
+// numbered as if what the loop assigns has been assigned already).
+void Optimizer::number_block(Node *list, Node *frame, std::unordered_map<int, size_t> available) {
+    for (unsigned i = 0; i < list->get_num_kids(); i++) {
+        Node *stmt = list->get_kid(i);
+        Node *s = stmt->get_kid(0);
+        switch (s->get_tag()) {
+            case AST_VARDEF:
+                count_assignments(s);
+                break;
+            case AST_WHILE:
+                count_assignments(s);
+                // fall through
+            case AST_IF:
+                number_expression(s, 0, frame, available);
+                for (unsigned k = 1; k < s->get_num_kids(); k++) {
+                    number_block(s->get_kid(k), frame, available);
+                }
+                break;
+            case AST_STATEMENT_LIST:
+                number_block(s, frame, available);
+                break;
+            default:
+                number_expression(stmt, 0, frame, available);
+                break;
+        }
+    }
+}
+
+// Number the expression that is a kid of parent, reusing the values in
+// available and adding those it works out whatever happens.
+void Optimizer::number_expression(Node *parent, unsigned index, Node *frame,
+                                  std::unordered_map<int, size_t> &available) {
+    // First number the nodes in the order they are evaluated, kids
+    // before parents, so a local's number changes as it is assigned.
+    // (The variable an assignment assigns to isn't evaluated, and the
+    // body of an inlined call is a block of its own.)
+    struct Visit {
+        Node *node;
+        unsigned next_kid;
+    };
+    std::unordered_map<Node *, int> numbers;
+    std::vector<Visit> stack(1, Visit{parent->get_kid(index), 0});
+    if (stack[0].node->get_tag() == AST_ASSIGN) {
+        stack[0].next_kid = 1;
+    }
+    while (!stack.empty()) {
+        Node *n = stack.back().node;
+        unsigned num_kids = n->get_num_kids() - (n->get_tag() == AST_INLINE_CALL ? 1 : 0);
+        if (stack.back().next_kid < num_kids) {
+            Node *kid = n->get_kid(stack.back().next_kid++);
+            stack.push_back(Visit{kid, kid->get_tag() == AST_ASSIGN ? 1u : 0u});
+            continue;
+        }
+        stack.pop_back();
+
+        int tag = n->get_tag();
+        int lhs, rhs;
+        switch (tag) {
+            case AST_INT_LITERAL:
+                if (get_constant(n, lhs)) {
+                    numbers[n] = value_number(tag, lhs, 0);
+                }
+                break;
+            case AST_VARREF:
+                if (n->get_num_kids() == 0 && n->get_scope().depth == 0 && n->get_scope().slot >= 0) {
+                    int slot = n->get_scope().slot;
+                    numbers[n] = value_number(tag, slot, m_versions[slot]);
+                }
+                break;
+            case AST_ASSIGN:
+            case AST_INLINE_CALL:
+                count_assignments(n);
+                break;
+            case AST_ADD:
+            case AST_SUB:
+            case AST_MULTIPLY:
+            case AST_DIVIDE:
+            case AST_AND:
+            case AST_OR:
+            case AST_LESS:
+            case AST_LESSEQUAL:
+            case AST_GREATER:
+            case AST_GREATEREQUAL:
+            case AST_EQUAL:
+            case AST_NOTEQUAL: {
+                auto l = numbers.find(n->get_kid(0)), r = numbers.find(n->get_kid(1));
+                if (l == numbers.end() || r == numbers.end()) {
+                    break;
+                }
+                lhs = l->second;
+                rhs = r->second;
+                // a + b is b + a, and so on
+                bool commutes = tag == AST_ADD || tag == AST_MULTIPLY || tag == AST_EQUAL || tag == AST_NOTEQUAL;
+                if (commutes && lhs > rhs) {
+                    std::swap(lhs, rhs);
+                }
+                numbers[n] = value_number(tag, lhs, rhs);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Then go through the operations in the same order, parents before
+    // kids: one whose number has been seen before is replaced by the
+    // local keeping the value of the first. Those evaluated only
+    // sometimes (the right operand of && or ||) can't be the first.
+    struct Entry {
+        Node *node, *parent;
+        unsigned index;
+        bool sometimes;
+    };
+    std::vector<Entry> pending(1, Entry{parent->get_kid(index), parent, index, false});
+    std::vector<Node *> bodies;
+    while (!pending.empty()) {
+        Entry e = pending.back();
+        pending.pop_back();
+        Node *n = e.node;
+        auto num = numbers.find(n);
+        if (num != numbers.end() && n->get_tag() != AST_INT_LITERAL && n->get_tag() != AST_VARREF) {
+            auto a = available.find(num->second);
+            if (a != available.end()) {
+                Occurrence &first = m_occurrences[a->second];
+                if (first.temp < 0) {
+                    ScopeInfo scope = frame->get_scope();
+                    first.temp = scope.num_slots++;
+                    frame->set_scope(scope);
+                    Node *assign = m_arena->make<Node>(AST_ASSIGN);
+                    assign->set_loc(first.node->get_loc());
+                    assign->append_kid(make_temp(first.temp, first.node));
+                    assign->append_kid(first.node);
+                    first.parent->set_kid(first.index, assign);
+                }
+                report(n, "reused value of common subexpression");
+                e.parent->set_kid(e.index, make_temp(first.temp, n));
+                continue;
+            }
+            if (!e.sometimes) {
+                available[num->second] = m_occurrences.size();
+                m_occurrences.push_back(Occurrence{n, e.parent, e.index, -1});
+            }
+        }
+
+        unsigned num_kids = n->get_num_kids();
+        switch (n->get_tag()) {
+            case AST_ASSIGN:
+                pending.push_back(Entry{n->get_kid(1), n, 1, e.sometimes});
+                continue;
+            case AST_INLINE_CALL:
+                bodies.push_back(n->get_last_kid());
+                num_kids--;
+                break;
+            default:
+                break;
+        }
+        for (unsigned k = num_kids; k-- > 0;) {
+            bool sometimes = e.sometimes || (k == 1 && (n->get_tag() == AST_AND || n->get_tag() == AST_OR));
+            pending.push_back(Entry{n->get_kid(k), n, k, sometimes});
+        }
+    }
+
+    // (an inlined function's variables are its own, so none of the
+    // values above are those of its expressions)
+    for (Node *body : bodies) {
+        number_block(body, frame, {});
+    }
+}
+
+int Optimizer::value_number(int tag, int a, int b) {
+    return m_numbers.insert({{tag, a, b}, int(m_numbers.size())}).first->second;
+}
+
+// Note that the locals some code may set have new values.
+void Optimizer::count_assignments(Node *code) {
+    std::unordered_set<int> slots;
+    find_written_slots(code, slots);
+    for (int slot : slots) {
+        m_versions[slot]++;
+    }
+}
+
+// Make a reference to a local added to keep the value of an expression.
+Node *Optimizer::make_temp(int slot, Node *from) {
+    Node *temp = m_arena->make<Node>(AST_VARREF);
+    temp->set_sym(symtab::intern("<temp>"));
+    temp->set_loc(from->get_loc());
+    ScopeInfo scope(0, slot);
+    scope.always_int = true;
+    temp->set_scope(scope);
+    return temp;
+}
+
+Node *Optimizer::make_int_literal(int val, Node *from) {
+    Node *lit = m_arena->make<Node>(AST_INT_LITERAL, std::to_string(val));
+    lit->set_loc(from->get_loc());
+    lit->set_int_value(val);
+    return lit;
+}
+
+void Optimizer::report(Node *where, const std::string &what) const {
+    if (m_verbose) {
+        const Location &loc = where->get_loc();
+        fprintf(stderr, "%s:%d:%d: %s\n", loc.get_srcfile().c_str(), loc.get_line(), loc.get_col(), what.c_str());
+    }
+}
+
+bool Optimizer::get_constant(Node *expr, int &val) {
+    if (expr->get_tag() != AST_INT_LITERAL || !expr->has_int_value()) {
+        return false;
+    }
+    val = expr->get_int_value();
+    return true;
+}
+
+// Whether evaluating an expression can't fail and has no effect: it is
+// made of literals, local variables (which always exist) and operators
+// that can't fail, since their operands are ints and the divisor of a
+// division is a constant that works for any dividend.
+bool Optimizer::has_no_effect(Node *expr) {
+    switch (expr->get_tag()) {
+        case AST_INT_LITERAL:
+        case AST_STRING:
+            return true;
+        case AST_VARREF:
+            return expr->get_num_kids() == 0 && expr->get_scope().slot >= 0;
+        default:
+            break;
+    }
+
+    std::vector<Node *> pending(1, expr);
+    while (!pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        int divisor;
+        switch (n->get_tag()) {
+            case AST_INT_LITERAL:
+                break;
+            case AST_VARREF:
+                if (n->get_num_kids() != 0 || !n->get_scope().always_int) {
+                    return false;
+                }
+                break;
+            case AST_DIVIDE:
+                if (!get_constant(n->get_kid(1), divisor) || divisor == 0 || divisor == -1) {
+                    return false;
+                }
+                // fall through
+            case AST_ADD:
+            case AST_SUB:
+            case AST_MULTIPLY:
+            case AST_AND:
+            case AST_OR:
+            case AST_LESS:
+            case AST_LESSEQUAL:
+            case AST_GREATER:
+            case AST_GREATEREQUAL:
+            case AST_EQUAL:
+            case AST_NOTEQUAL:
+                pending.insert(pending.end(), n->cbegin(), n->cend());
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// Add the assignments to local variables in a statement to assigns.
+void Optimizer::find_assigns(Node *stmt, std::vector<Node *> &assigns) {
+    std::vector<Node *> pending(1, stmt);
+    while (!pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        if (n->get_tag() == AST_ASSIGN && n->get_kid(0)->get_scope().depth == 0 &&
+            n->get_kid(0)->get_scope().slot >= 0) {
+            assigns.push_back(n);
+        }
+        pending.insert(pending.end(), n->cbegin(), n->cend());
+    }
+}
+
+// Whether an expression's value is always an int (if it has one).
+bool Optimizer::is_int(Node *expr) {
+    switch (expr->get_tag()) {
+        case AST_INT_LITERAL:
+            return expr->has_int_value();
+        case AST_VARREF:
+            return expr->get_num_kids() == 0 && expr->get_scope().always_int;
+        case AST_ADD:
+        case AST_SUB:
+        case AST_MULTIPLY:
+        case AST_DIVIDE:
+        case AST_AND:
+        case AST_OR:
+        case AST_LESS:
+        case AST_LESSEQUAL:
+        case AST_GREATER:
+        case AST_GREATEREQUAL:
+        case AST_EQUAL:
+        case AST_NOTEQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Add the slots of the locals that running some code may set to slots:
+// those assigned, declared, or given to the parameters of an inlined
+// function.
+void Optimizer::find_written_slots(Node *code, std::unordered_set<int> &slots) {
+    std::vector<Node *> pending(1, code);
+    while (!pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        switch (n->get_tag()) {
+            case AST_ASSIGN:
+                if (n->get_kid(0)->get_scope().slot >= 0) {
+                    slots.insert(n->get_kid(0)->get_scope().slot);
+                }
+                break;
+            case AST_VARDEF:
+                if (n->get_last_kid()->get_scope().slot >= 0) {
+                    slots.insert(n->get_last_kid()->get_scope().slot);
+                }
+                break;
+            case AST_INLINE_CALL:
+                for (unsigned k = 0; k + 1 < n->get_num_kids(); k++) {
+                    slots.insert(n->get_scope().slot + int(k));
+                }
+                break;
+            default:
+                break;
+        }
+        pending.insert(pending.end(), n->cbegin(), n->cend());
+    }
+}
@@ -0,0 +1,169 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <array>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "symtab.h"
+#include "intrinsic.h"
+
+class Arena;
+
+class Node;
+
+// Simplifies an AST once ScopeResolver has resolved it, so the
+// interpreter does less work each time the code runs: it folds
+// operations on int literals and identity arithmetic (x + 0, x * 1),
+// replaces locals assigned at most once by their known values, removes
+// code that can't make a difference, reuses the values of repeated
+// operations, inlines calls of small functions and works out loop
+// invariants once. Anything that can fail still fails when, and where,
+// it would have without the optimizer.
+class Optimizer {
+private:
+    // the most nodes a function body can have to be inlined
+    static const unsigned MAX_INLINE_SIZE = 40;
+
+    // What a call may do besides working out its result from its
+    // arguments, from least to most: the IntrinsicEffects, and
+    // anything at all, such as changing global variables
+    enum Effect {
+        EFFECT_NONE = INTRINSIC_PURE,
+        EFFECT_READS_ARRAYS = INTRINSIC_READS_ARRAYS,
+        EFFECT_OTHER = INTRINSIC_OTHER_EFFECT,
+        EFFECT_WRITES_ARRAYS = INTRINSIC_WRITES_ARRAYS,
+        EFFECT_ANY,
+    };
+
+    // nodes made by the optimizer go here
+    Arena *m_arena;
+    // whether to report what was removed
+    bool m_verbose;
+    // values of the locals known to be constant at this point, by slot
+    std::unordered_map<int, int> m_consts;
+    // what calling each global known to be an intrinsic or a function
+    // may do
+    std::unordered_map<Symbol, Effect> m_effects;
+
+    // an expression whose value may be reused (see number_values())
+    struct Occurrence {
+        Node *node, *parent;
+        unsigned index;
+        // the slot its value is kept in, or -1 until it's reused
+        int temp;
+    };
+    // value numbering: the number of each expression, by its operator
+    // (or AST_INT_LITERAL or AST_VARREF) and its operands' numbers (or
+    // the literal's value, or the local's slot and version); how many
+    // times each local has been assigned so far; and the expressions
+    // that may be reused in the frame being numbered
+    std::map<std::array<int, 3>, int> m_numbers;
+    std::unordered_map<int, int> m_versions;
+    std::vector<Occurrence> m_occurrences;
+
+public:
+    explicit Optimizer(Arena *arena);
+
+    // Report each piece of code removed, each call inlined and each
+    // loop invariant found, on stderr.
+    void set_verbose(bool verbose) { m_verbose = verbose; }
+
+    // Optimize a program or module.
+    void optimize_unit(Node *unit);
+
+    // Empty the body of each function of a program that no code run
+    // by it can call: one not named by the program's top-level
+    // statements, or by the functions they name, and so on. Its
+    // definition stays, so that defining it again is still an error.
+    // Does nothing if the program imports modules (which may call any
+    // function) or has function bodies still to be parsed. Calling it
+    // again after optimize_unit(), which can remove calls, may empty
+    // more.
+    void remove_unused_functions(Node *unit);
+
+    // Inline the calls of a program's small functions that aren't
+    // recursive, in function bodies and top-level blocks. Only
+    // functions that are certain to be what their name refers to
+    // whenever code runs are inlined: ones defined once, before any
+    // statement but a var statement, whose name isn't assigned to or
+    // declared as a variable. Does nothing if the program imports
+    // modules or has function bodies still to be parsed. Call after
+    // optimize_unit(), so the function bodies are as small as they get.
+    void inline_functions(Node *unit);
+
+    // Work out the expressions in the while loops of a program (in
+    // function bodies and blocks) that the loop can't change just once
+    // each time the loop runs: ones made of literals, operators,
+    // variables the loop doesn't assign, and calls of intrinsics and
+    // functions that only depend on their arguments (and perhaps on
+    // what is in arrays, if the loop changes none). The same functions
+    // as for inline_functions() are known. Does nothing if the program
+    // imports modules or has function bodies still to be parsed. Call
+    // after inline_functions(), so inlined code is covered.
+    void hoist_invariants(Node *unit);
+
+    // Optimize one top-level statement (TStmt) of a unit. The body of
+    // a function whose parsing was deferred is left for later.
+    void optimize_top_level(Node *stmt);
+
+    // Optimize the body of a function, e.g. one whose parsing was
+    // deferred.
+    void optimize_function(Node *body);
+
+private:
+    void optimize_block(Node *list, bool value_used);
+
+    bool optimize_statement(Node *stmt, bool value_used);
+
+    Node *optimize_expression(Node *expr);
+
+    Node *fold(Node *expr);
+
+    Node *reduce(Node *expr);
+
+    Node *make_int_literal(int val, Node *from);
+
+    void number_values(Node *code);
+
+    void number_block(Node *list, Node *frame, std::unordered_map<int, size_t> available);
+
+    void number_expression(Node *parent, unsigned index, Node *frame, std::unordered_map<int, size_t> &available);
+
+    int value_number(int tag, int a, int b);
+
+    void count_assignments(Node *code);
+
+    Node *make_temp(int slot, Node *from);
+
+    void inline_calls(Node *code, const std::unordered_map<Symbol, Node *> &inlinable);
+
+    Node *copy_body(Node *body, int first_slot);
+
+    void hoist_in(Node *code);
+
+    void hoist_loop(Node *loop, Node *frame, bool cond_in_frame);
+
+    Effect code_effect(Node *code) const;
+
+    Effect ref_effect(Node *ref) const;
+
+    void report(Node *where, const std::string &what) const;
+
+    static bool get_constant(Node *expr, int &val);
+
+    static bool has_no_effect(Node *expr);
+
+    static bool is_int(Node *expr);
+
+    static void find_written_slots(Node *code, std::unordered_set<int> &slots);
+
+    static void find_assigns(Node *stmt, std::vector<Node *> &assigns);
+
+    static bool find_functions(Node *unit, std::vector<Node *> &functions, std::unordered_map<Symbol, Node *> &fixed,
+                               std::unordered_set<Symbol> &rebound);
+};
+
+#endif // OPTIMIZER_H
@@ -1,10 +1,15 @@
 #include <string>
 #include <memory>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
 #include <iostream>
 #include <cassert>
 #include "token.h"
 #include "ast.h"
 #include "exceptions.h"
+#include "arena.h"
 #include "parser2.h"
 
 ////////////////////////////////////////////////////////////////////////
@@ -24,6 +29,7 @@
 // Stmt -> A ;
 // Stmt → var ident ;
 // TStmt →      Func
+// TStmt →      import string_literal ;                   -- import a module
 // Func →       function ident ( OptPList ) { SList }     -- function definition
 // OptPList →   PList                                     -- optional parameter list
 // OptPList →   ε
@@ -60,12 +66,15 @@
 // F → string_literal
 // F -> ident
 // F -> ( A )
+//
+// A, L, R, E, T and F are not parsed by a function each: see
+// parse_expression(), which handles the operators from a table.
 
 
 
-
-Parser2::Parser2(Lexer *lexer_to_adopt)
-        : m_lexer(lexer_to_adopt), m_next() {
+Parser2::Parser2(Lexer *lexer_to_adopt, Arena *arena)
+        : m_lexer(lexer_to_adopt), m_arena(arena), m_lazy_functions(false), m_started(false), m_num_threads(1),
+          m_deferred(nullptr) {
 }
 
 Parser2::~Parser2() {
@@ -73,36 +82,146 @@ Parser2::~Parser2() {
 }
 
 Node *Parser2::parse() {
+    if (m_num_threads > 1 && !m_lazy_functions) {
+        return parse_parallel();
+    }
     return parse_Unit();
 }
 
+// Parse the unit in two passes: a pre-scan that parses the top-level
+// statements as in lazy mode, only brace-matching function bodies,
+// and then the bodies, spread over a pool of threads. Each thread
+// allocates in an arena of its own, and the bodies are spliced into
+// their functions afterwards.
+Node *Parser2::parse_parallel() {
+    std::vector<DeferredBody *> deferred;
+    Node *unit = nullptr;
+    std::exception_ptr scan_error;
+    m_deferred = &deferred;
+    m_lazy_functions = true;
+    try {
+        unit = parse_Unit();
+    } catch (...) {
+        scan_error = std::current_exception();
+    }
+    m_deferred = nullptr;
+    m_lazy_functions = false;
+
+    // each thread (including this one) takes the next unparsed body
+    std::vector<Node *> bodies(deferred.size());
+    std::vector<std::exception_ptr> errors(deferred.size());
+    std::atomic<size_t> next_body(0), first_error(deferred.size());
+    auto worker = [&](Arena *arena) {
+        for (size_t i; (i = next_body.fetch_add(1)) < deferred.size();) {
+            if (i > first_error.load()) {
+                // only the first error is reported
+                break;
+            }
+            try {
+                bodies[i] = deferred[i]->parse(arena);
+            } catch (...) {
+                errors[i] = std::current_exception();
+                size_t first = first_error.load();
+                while (i < first && !first_error.compare_exchange_weak(first, i)) {
+                }
+            }
+        }
+    };
+    size_t num_workers = std::min(size_t(m_num_threads), deferred.size());
+    std::vector<std::unique_ptr<Arena>> arenas;
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < num_workers; i++) {
+        arenas.emplace_back(new Arena);
+        if (i > 0) {
+            pool.emplace_back(worker, arenas.back().get());
+        }
+    }
+    if (num_workers > 0) {
+        worker(arenas[0].get());
+    }
+    for (auto i = pool.begin(); i != pool.end(); ++i) {
+        i->join();
+    }
+
+    // Report the earliest error. Every body precedes the point where
+    // the pre-scan stopped, so errors in bodies come first.
+    if (first_error.load() < errors.size()) {
+        std::rethrow_exception(errors[first_error.load()]);
+    }
+    if (scan_error) {
+        std::rethrow_exception(scan_error);
+    }
+
+    // The workers' arenas go away when this returns, so the nodes they
+    // made must allocate from m_arena, which now holds their memory.
+    for (auto i = arenas.begin(); i != arenas.end(); ++i) {
+        m_arena->absorb(**i);
+    }
+    std::vector<Node *> pending(bodies.begin(), bodies.end());
+    while (!pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        n->set_arena(m_arena);
+        pending.insert(pending.end(), n->cbegin(), n->cend());
+    }
+    // functions are only defined at the top level, in the same order
+    // as the bodies were skipped
+    size_t next = 0;
+    for (unsigned i = 0; i < unit->get_num_kids(); i++) {
+        Node *func = unit->get_kid(i);
+        if (func->get_tag() == AST_FUNCTION) {
+            assert(func->get_last_kid() == deferred[next]);
+            func->set_kid(func->get_num_kids() - 1, bodies[next++]);
+        }
+    }
+    assert(next == bodies.size());
+    return unit;
+}
+
+Node *Parser2::parse_next() {
+    // Unit -> TStmt
+    // Unit -> TStmt Unit
+    if (m_started && m_lexer->peek() == nullptr) {
+        return nullptr;
+    }
+    m_started = true;
+    return parse_TStmt();
+}
+
+bool Parser2::at_function() {
+    const Token *next_tok = m_lexer->peek();
+    return next_tok != nullptr && next_tok->get_kind() == TOK_FN;
+}
+
 Node *Parser2::parse_Unit() {
     // note that this function produces a "flattened" representation
     // of the unit
 
-    std::unique_ptr<Node> unit(new Node(AST_UNIT));
+    Node *unit = m_arena->make<Node>(AST_UNIT);
     for (;;) {
         unit->append_kid(parse_TStmt());
         if (m_lexer->peek() == nullptr)
             break;
     }
 
-    return unit.release();
+    return unit;
 }
 
 Node *Parser2::parse_TStmt() {
     //TStmt →      Func
     //TStmt →      Stmt
-    std::unique_ptr<Node> s(new Node(AST_STATEMENT));
 
-    Node *next_tok = m_lexer->peek();
+    const Token *next_tok = m_lexer->peek();
 
     if (next_tok == nullptr) {
         SyntaxError::raise(m_lexer->get_current_loc(), "Unexpected end of input looking for statement");
 
-    } else if (next_tok->get_tag() == TOK_FN) {
+    } else if (next_tok->get_kind() == TOK_FN) {
         //TStmt →      Func
         return parse_Func();
+    } else if (next_tok->get_kind() == TOK_IMPORT) {
+        //TStmt →      import string_literal ;
+        return parse_import();
     }
 
     //TStmt →      Stmt
@@ -117,22 +236,22 @@ Node *Parser2::parse_Stmt() {
     // Stmt ->  if ( A ) { SList } else { SList }         -- if/else statement
     // Stmt ->  while ( A ) { SList }                     -- while loop
 
-    std::unique_ptr<Node> s(new Node(AST_STATEMENT));
+    Node *s = m_arena->make<Node>(AST_STATEMENT);
 
-    Node *next_tok = m_lexer->peek();
+    const Token *next_tok = m_lexer->peek();
     if (next_tok == nullptr) {
         SyntaxError::raise(m_lexer->get_current_loc(), "Unexpected end of input looking for statement");
 
     }
 
-    int tag = next_tok->get_tag();
+    int tag = next_tok->get_kind();
 
     if (tag == TOK_VAR) {
         // Stmt -> ^ var ident ;
         s->append_kid(parse_var());
         // Stmt -> var ident ^ ;
         expect_and_discard(TOK_SEMICOLON);
-        return s.release();
+        return s;
 
     } else if (tag == TOK_IF || tag == TOK_WHILE) {
         // Stmt →      ^ if ( A ) { SList }                        -- if statement
@@ -154,31 +273,28 @@ Node *Parser2::parse_Stmt() {
 
         // Stmt →      ctrl ( A ) ^{ SList }
         expect_and_discard(TOK_LBRACE);
-        std::unique_ptr<Node> slist(new Node(AST_STATEMENT_LIST));
         ast->append_kid(parse_SList());
         expect_and_discard(TOK_RBRACE);
 
         // Could very easily allow for else statements on while loops
         next_tok = m_lexer->peek();
-        if (next_tok != nullptr && next_tok->get_tag() == TOK_ELSE && ast->get_tag() == AST_IF) {
+        if (next_tok != nullptr && next_tok->get_kind() == TOK_ELSE && ast->get_tag() == AST_IF) {
             // Stmt →       if ( A ) { SList } ^else { SList }
             expect_and_discard(TOK_ELSE);
             expect_and_discard(TOK_LBRACE);
             // generate node for content of loop
-
-            std::unique_ptr<Node> else_slist(new Node(AST_STATEMENT_LIST));
             ast->append_kid(parse_SList());
             expect_and_discard(TOK_RBRACE);
         }
         s->append_kid(ast);
-        return s.release();
+        return s;
 
     }
     // Stmt -> ^ A ;
     s->append_kid(parse_A());
     expect_and_discard(TOK_SEMICOLON);
 
-    return s.release();
+    return s;
 }
 
 Node *Parser2::parse_Func() {
@@ -191,7 +307,11 @@ Node *Parser2::parse_Func() {
     func_ast->append_kid(parse_OptPList());
     expect_and_discard(TOK_RPAREN);
 
-    expect_and_discard(TOK_LBRACE);
+    Token lbrace = expect(TOK_LBRACE);
+    if (m_lazy_functions) {
+        func_ast->append_kid(skip_body(lbrace));
+        return func_ast;
+    }
     func_ast->append_kid(parse_SList());
     expect_and_discard(TOK_RBRACE);
 
@@ -199,21 +319,63 @@ Node *Parser2::parse_Func() {
     return func_ast;
 }
 
+// Skip over a function body, up to and including the matching
+// right brace, and return a placeholder for it.
+Node *Parser2::skip_body(const Token &lbrace) {
+    int depth = 1;
+    try {
+        for (;;) {
+            Token tok = m_lexer->next();
+            if (tok.get_kind() == TOK_LBRACE) {
+                depth++;
+            } else if (tok.get_kind() == TOK_RBRACE && --depth == 0) {
+                return defer_body(lbrace);
+            }
+        }
+    } catch (BaseException &) {
+        if (m_deferred != nullptr) {
+            // the body may still have a syntax error before this error
+            defer_body(lbrace);
+        }
+        throw;
+    }
+}
+
+// The body is parsed from the rest of the input, just as if it hadn't
+// been skipped, so that it ends (and any error in it is found) exactly
+// where it would have otherwise.
+Node *Parser2::defer_body(const Token &lbrace) {
+    DeferredBody *body = m_arena->make<DeferredBody>(m_lexer->get_span(lbrace));
+    body->set_loc(m_lexer->get_loc(lbrace));
+    if (m_deferred != nullptr) {
+        m_deferred->push_back(body);
+    }
+    return body;
+}
+
+Node *Parser2::parse_import() {
+    // TStmt →      import ^ string_literal ;
+    // (the node's string is the module's path)
+    Token import_tok = expect(TOK_IMPORT);
+    Node *ast = token_to_node(AST_IMPORT, expect(TOK_STRING));
+    ast->set_loc(m_lexer->get_loc(import_tok));
+    expect_and_discard(TOK_SEMICOLON);
+    return ast;
+}
+
 Node *Parser2::parse_OptPList() {
     // OptPList →   PList                                     -- optional parameter list
     // OptPList →   ε
 
-    std::unique_ptr<Node> s(new Node(AST_PARAMETER_LIST));
-
-    Node *next_tok = m_lexer->peek();
+    const Token *next_tok = m_lexer->peek();
 
-    if (next_tok != nullptr && next_tok->get_tag() == TOK_IDENTIFIER) {
+    if (next_tok != nullptr && next_tok->get_kind() == TOK_IDENTIFIER) {
         // OptPList →   ^PList
         // PList starts with identifier
         return parse_PList();
     }
     // OptPList →   ^ε
-    return s.release();
+    return m_arena->make<Node>(AST_PARAMETER_LIST);
 }
 
 
@@ -221,395 +383,367 @@ Node *Parser2::parse_PList() {
     // PList →      ident                                     -- nonempty parameter list
     // PList →      ident , PList
 
-    std::unique_ptr<Node> opt_list(new Node(AST_PARAMETER_LIST));
+    Node *opt_list = m_arena->make<Node>(AST_PARAMETER_LIST);
 
 
     opt_list->append_kid(parse_ident());
 
-    Node *next_tok = m_lexer->peek(1);
-    while (next_tok->get_tag() == TOK_COMMA) {
+    const Token *next_tok = m_lexer->peek(1);
+    while (next_tok != nullptr && next_tok->get_kind() == TOK_COMMA) {
         expect_and_discard(TOK_COMMA);
         opt_list->append_kid(parse_ident());
         next_tok = m_lexer->peek();
     }
-    return opt_list.release();
-}
-
-Node *Parser2::parse_OptArgList() {
-    // OptArgList → ArgList                                   -- optional argument list
-    // OptArgList → ε
-
-    std::unique_ptr<Node> s(new Node(AST_ARGLIST));
-
-    Node *next_tok = m_lexer->peek(1);
-
-    if (next_tok->get_tag() != TOK_RPAREN) {
-        // OptPList →   ^PList
-        // PList starts with identifier
-        return parse_ArgList(s.release());
-    }
-    // OptPList →   ^ε
-    return s.release();
+    return opt_list;
 }
 
-
-Node *Parser2::parse_ArgList(Node *arg_list_) {
-    // ArgList →    L                                         -- nonempty argument list
-    // ArgList →    L , ArgList
-
-    std::unique_ptr<Node> arg_list(arg_list_);
-
-
-    arg_list->append_kid(parse_L());
-
-    Node *next_tok = m_lexer->peek(1);
-    while (next_tok->get_tag() == TOK_COMMA) {
-        expect_and_discard(TOK_COMMA);
-        arg_list->append_kid(parse_L());
-        next_tok = m_lexer->peek();
-    }
-    return arg_list.release();
-}
-
-
 Node *Parser2::parse_SList() {
     // SList →      Stmt                                      -- statement list
     // SList →      Stmt SList
-    std::unique_ptr<Node> slist(new Node(AST_STATEMENT_LIST));
+    Node *slist = m_arena->make<Node>(AST_STATEMENT_LIST);
 
-    Node *next_tok = m_lexer->peek();
+    const Token *next_tok = m_lexer->peek();
 
     // Keep searching for new segments until you hit the end of the function scope
-    while (next_tok->get_tag() != TOK_RBRACE) {
+    while (next_tok != nullptr && next_tok->get_kind() != TOK_RBRACE) {
         slist->append_kid(parse_Stmt());
         next_tok = m_lexer->peek();
     }
-    return slist.release();
+    return slist;
 }
 
 
-Node *Parser2::parse_A() {
-    // A → ^ ident = A
-    // A → ^ L
-
-    Node *next_tok = m_lexer->peek(1);
-    Node *next_next_tok = m_lexer->peek(2);
-    if (next_tok == nullptr || next_next_tok == nullptr) {
-        Parser2::error_at_current_loc("Unexpected end of input");
-    }
-    int next_tok_tag = next_tok->get_tag();
-    int next_next_tok_tag = next_next_tok->get_tag();
-    if (next_tok_tag == TOK_IDENTIFIER && next_next_tok_tag == TOK_ASSIGN) {
-        // A → ^ ident = A
-        return parse_assign();
-    } else {
-        // A → ^ L
-        return parse_L();
+namespace {
+
+enum Assoc {
+    LEFT_ASSOC, // a - b - c is (a - b) - c
+    NON_ASSOC,  // a < b < c is an error
+};
+
+struct BinaryOp {
+    TokenKind tok;
+    ASTKind ast;
+    int prec;         // higher binds tighter
+    Assoc assoc;
+    bool keep_lexeme; // the node's string is the operator's lexeme
+};
+
+// The binary operators, from loosest to tightest binding. Adding an
+// operator only needs a row here (plus its token and AST kinds).
+const BinaryOp BINARY_OPS[] = {
+    {TOK_OR,           AST_OR,           1, NON_ASSOC,  true},
+    {TOK_AND,          AST_AND,          1, NON_ASSOC,  true},
+    {TOK_LESS,         AST_LESS,         2, NON_ASSOC,  true},
+    {TOK_LESSEQUAL,    AST_LESSEQUAL,    2, NON_ASSOC,  true},
+    {TOK_GREATER,      AST_GREATER,      2, NON_ASSOC,  true},
+    {TOK_GREATEREQUAL, AST_GREATEREQUAL, 2, NON_ASSOC,  true},
+    {TOK_EQUAL,        AST_EQUAL,        2, NON_ASSOC,  true},
+    {TOK_NOTEQUAL,     AST_NOTEQUAL,     2, NON_ASSOC,  true},
+    {TOK_PLUS,         AST_ADD,          3, LEFT_ASSOC, false},
+    {TOK_MINUS,        AST_SUB,          3, LEFT_ASSOC, false},
+    {TOK_TIMES,        AST_MULTIPLY,     4, LEFT_ASSOC, false},
+    {TOK_DIVIDE,       AST_DIVIDE,       4, LEFT_ASSOC, false},
+};
+
+const BinaryOp *find_binary_op(const Token *tok) {
+    if (tok == nullptr) {
+        return nullptr;
     }
-}
-
-Node *Parser2::parse_L() {
-    //L    → R || R
-    //L    → R && R
-    //L    → R
-
-    Node *lhs = parse_R();
-
-    Node *next_tok = m_lexer->peek();
-
-    if (next_tok != nullptr) {
-        if (next_tok->get_tag() == TOK_AND || next_tok->get_tag() == TOK_OR) {
-            //L    → R ^|| R
-            //L    → R ^&& R
-
-            int tag = next_tok->get_tag();
-
-            int ast_tag = tok_to_ast(static_cast<TokenKind>(tag));
-            std::unique_ptr<Node> op(expect(static_cast<enum TokenKind>(tag)));
-            //L    → R ||^ R
-            //L    → R &&^ R
-            Node *rhs = parse_R();
-            op->append_kid(lhs);
-            op->append_kid(rhs);
-            op->set_str(next_tok->get_str());
-            op->set_loc(next_tok->get_loc());
-            op->set_tag(ast_tag);
-
-            return op.release();
+    for (const BinaryOp &op : BINARY_OPS) {
+        if (op.tok == tok->get_kind()) {
+            return &op;
         }
-
-    }
-
-    //L    → R
-    return lhs;
-
-}
-
-Node *Parser2::parse_R() {
-    //R    → E < E
-    //R    → E <= E
-    //R    → E > E
-    //R    → E >= E
-    //R    → E == E
-    //R    → E != E
-    //R    → E
-
-    //R    → ^E op E
-    Node *lhs = parse_E();
-
-    Node *next_tok = m_lexer->peek(1);
-
-    if (next_tok == nullptr) {
-        Parser2::error_at_current_loc("Unexpected end of input");
-    }
-    if (valid_operand(next_tok->get_tag())) {
-        //R    → E ^op E
-        std::unique_ptr<Node> tok(expect(static_cast<enum TokenKind>(next_tok->get_tag())));
-        int ast_tag = tok_to_ast(static_cast<TokenKind>(next_tok->get_tag()));
-        std::unique_ptr<Node> ast(new Node(ast_tag));
-        //R    → E op ^E
-        Node *rhs = parse_E();
-        ast->append_kid(lhs);
-        ast->append_kid(rhs);
-        ast->set_str(tok->get_str());
-        ast->set_loc(tok->get_loc());
-        return ast.release();
     }
-
-    //R    → E
-    return lhs;
+    return nullptr;
 }
 
-bool Parser2::valid_operand(int tok) {
-    switch (tok) {
-        case TOK_LESS:
-        case TOK_LESSEQUAL:
-        case TOK_GREATER:
-        case TOK_GREATEREQUAL:
-        case TOK_EQUAL:
-        case TOK_NOTEQUAL:
-            return true;
-        default:
-            return false;
-    }
-}
-
-
-Node *Parser2::parse_E() {
-    // E -> ^ T E'
-
-    // Get the AST corresponding to the term (T)
-
-    Node *ast = parse_T();
-
-    // Recursively continue the additive expression
-    return parse_EPrime(ast);
-}
-
-// This function is passed the "current" portion of the AST
-// that has been built so far for the additive expression.
-Node *Parser2::parse_EPrime(Node *ast_) {
-    // E' -> ^ + T E'
-    // E' -> ^ - T E'
-    // E' -> ^ epsilon
-
-
-    std::unique_ptr<Node> ast(ast_);
-
-    // peek at next token
-    Node *next_tok = m_lexer->peek();
-    if (next_tok != nullptr) {
-        int next_tok_tag = next_tok->get_tag();
-        if (next_tok_tag == TOK_PLUS || next_tok_tag == TOK_MINUS) {
-            // E' -> ^ + T E'
-            // E' -> ^ - T E'
-            std::unique_ptr<Node> op(expect(static_cast<enum TokenKind>(next_tok_tag)));
-
-            // build AST for next term, incorporate into current AST
-            Node *term_ast = parse_T();
-            // E' ->  - T^ E'
-            ast.reset(new Node(tok_to_ast(static_cast<TokenKind>(next_tok_tag)), {ast.release(), term_ast}));
-
-            // copy source information from operator node
-            ast->set_loc(op->get_loc());
-
-            // continue recursively
-            return parse_EPrime(ast.release());
-        }
-    }
-    // E' -> ^ epsilon
-    // No more additive operators, so just return the completed AST
-    return ast.release();
 }
 
-Node *Parser2::parse_T() {
-    // T -> F T'
-
-    // Parse primary expression
-    Node *ast = parse_F();
+// A construct parse_expression() is in the middle of. Each frame owns
+// the operands and operators pushed since it started.
+struct Parser2::ExprFrame {
+    enum Kind {
+        TOP,    // the whole expression
+        PAREN,  // ( A )
+        ARGS,   // an argument of a call; node is the AST_ARGLIST
+        ASSIGN, // right-hand side of ident = A; node is the AST_ASSIGN
+    };
+
+    Kind kind;
+    size_t operand_base, operator_base;
+    Node *node;
+};
+
+struct Parser2::PendingOp {
+    const BinaryOp *op;
+    Token tok;
+};
 
-    // Recursively continue the multiplicative expression
-    return parse_TPrime(ast);
+Node *Parser2::parse_A() {
+    return parse_expression();
 }
 
-Node *Parser2::parse_TPrime(Node *ast_) {
-    // T' -> ^ * F T'
-    // T' -> ^ / F T'
-    // T' -> ^ epsilon
-
-    std::unique_ptr<Node> ast(ast_);
-
-    // peek at next token
-    Node *next_tok = m_lexer->peek(1);
-    if (next_tok != nullptr) {
-        int next_tok_tag = next_tok->get_tag();
-        if (next_tok_tag == TOK_TIMES || next_tok_tag == TOK_DIVIDE) {
-            // T' -> ^ * F T'
-            // T' -> ^ / F T'
-
-            std::unique_ptr<Node> op(expect(static_cast<enum TokenKind>(next_tok_tag)));
-
-            // build AST for next primary expression, incorporate into current AST
-            Node *primary_ast = parse_F();
-            ast.reset(new Node(tok_to_ast(static_cast<TokenKind>(next_tok_tag)), {ast.release(), primary_ast}));
-
-            // copy source information from operator node
-            ast->set_loc(op->get_loc());
+// Parse an A by precedence climbing. Nesting (parentheses, call
+// arguments, assignments) is kept on m_frames rather than the C++
+// stack, so deeply nested input can't overflow it, and the operators
+// come from BINARY_OPS rather than one function per precedence level.
+// The trees built (and the errors reported) are the same as for the
+// grammar above.
+Node *Parser2::parse_expression() {
+    enum State {
+        OPERAND,   // expecting a primary expression
+        OPERATOR,  // after an operand: expecting a binary operator
+        FRAME_END, // the innermost frame has no more operators
+    };
+
+    m_frames.clear();
+    m_operands.clear();
+    m_operators.clear();
+    m_frames.push_back({ExprFrame::TOP, 0, 0, nullptr});
+
+    State state = OPERAND;
+    bool a_start = true; // at the start of an A, so ident = A is allowed
+    for (;;) {
+        if (state == OPERAND) {
+            if (a_start) {
+                // A → ^ ident = A
+                // A → ^ L
+                const Token *next_tok = m_lexer->peek(1);
+                const Token *next_next_tok = m_lexer->peek(2);
+                if (next_tok == nullptr || next_next_tok == nullptr) {
+                    error_at_current_loc("Unexpected end of input");
+                }
+                if (next_tok->get_kind() == TOK_IDENTIFIER && next_next_tok->get_kind() == TOK_ASSIGN) {
+                    Node *lhs = parse_ident();
+                    expect_and_discard(TOK_ASSIGN);
+                    Node *ast = m_arena->make<Node>(AST_ASSIGN);
+                    ast->set_loc(lhs->get_loc());
+                    ast->set_str("=");
+                    ast->append_kid(lhs);
+                    // A → ident = ^ A
+                    m_frames.push_back({ExprFrame::ASSIGN, m_operands.size(), m_operators.size(), ast});
+                    continue;
+                }
+                a_start = false;
+            }
+
+            // F -> ^ number
+            // F -> ^ ident
+            // F -> ^ ident ( OptArgList )     -- function call
+            // F -> ^ ( A )
+            // F -> ^ string_literal
+            const Token *next_tok = m_lexer->peek();
+            if (next_tok == nullptr) {
+                error_at_current_loc("Unexpected end of input looking for primary expression");
+            }
+            int tag = next_tok->get_kind();
+            if (tag == TOK_INTEGER_LITERAL || tag == TOK_IDENTIFIER || tag == TOK_STRING) {
+                Token tok = expect(static_cast<enum TokenKind>(tag));
+                Node *ast = token_to_node(tok_to_ast(tok.get_kind()), tok);
+                m_operands.push_back(ast);
+                state = OPERATOR;
+                next_tok = m_lexer->peek();
+                if (next_tok != nullptr && next_tok->get_kind() == TOK_LPAREN) {
+                    // F -> ident ^ ( OptArgList )
+                    expect_and_discard(TOK_LPAREN);
+                    Node *arg_list = m_arena->make<Node>(AST_ARGLIST);
+                    ast->append_kid(arg_list);
+                    next_tok = m_lexer->peek();
+                    if (next_tok != nullptr && next_tok->get_kind() != TOK_RPAREN) {
+                        // ArgList →    ^ L
+                        // ArgList →    ^ L , ArgList
+                        m_frames.push_back({ExprFrame::ARGS, m_operands.size(), m_operators.size(), arg_list});
+                        state = OPERAND;
+                    } else {
+                        expect_and_discard(TOK_RPAREN);
+                    }
+                }
+            } else if (tag == TOK_LPAREN) {
+                // F -> ( ^ A )
+                expect_and_discard(TOK_LPAREN);
+                m_frames.push_back({ExprFrame::PAREN, m_operands.size(), m_operators.size(), nullptr});
+                a_start = true;
+            } else {
+                SyntaxError::raise(m_lexer->get_loc(*next_tok), "Invalid primary expression");
+            }
+
+        } else if (state == OPERATOR) {
+            const Token *next_tok = m_lexer->peek();
+            if (next_tok == nullptr) {
+                error_at_current_loc("Unexpected end of input");
+            }
+            const BinaryOp *op = find_binary_op(next_tok);
+            if (op == nullptr) {
+                state = FRAME_END;
+                continue;
+            }
+            // finish operators that bind at least as tightly
+            const ExprFrame &frame = m_frames.back();
+            while (m_operators.size() > frame.operator_base && m_operators.back().op->prec > op->prec) {
+                reduce();
+            }
+            if (m_operators.size() > frame.operator_base && m_operators.back().op->prec == op->prec) {
+                if (op->assoc == NON_ASSOC) {
+                    // leave the operator for the caller to report
+                    state = FRAME_END;
+                    continue;
+                }
+                reduce();
+            }
+            m_operators.push_back({op, m_lexer->next()});
+            state = OPERAND;
 
-            // continue recursively
-            return parse_TPrime(ast.release());
+        } else {
+            ExprFrame frame = m_frames.back();
+            while (m_operators.size() > frame.operator_base) {
+                reduce();
+            }
+            assert(m_operands.size() == frame.operand_base + 1);
+            Node *result = m_operands.back();
+            m_operands.pop_back();
+
+            switch (frame.kind) {
+                case ExprFrame::TOP:
+                    m_frames.pop_back();
+                    return result;
+                case ExprFrame::PAREN:
+                    // F -> ( A ^ )
+                    m_frames.pop_back();
+                    expect_and_discard(TOK_RPAREN);
+                    m_operands.push_back(result);
+                    state = OPERATOR;
+                    break;
+                case ExprFrame::ARGS:
+                    frame.node->append_kid(result);
+                    if (m_lexer->peek() != nullptr && m_lexer->peek()->get_kind() == TOK_COMMA) {
+                        // ArgList →    L ^ , ArgList
+                        expect_and_discard(TOK_COMMA);
+                        state = OPERAND;
+                    } else {
+                        // F -> ident ( OptArgList ^ )
+                        // (the call itself is already an operand of the enclosing frame)
+                        m_frames.pop_back();
+                        expect_and_discard(TOK_RPAREN);
+                        state = OPERATOR;
+                    }
+                    break;
+                case ExprFrame::ASSIGN:
+                    // A → ident = A ^
+                    m_frames.pop_back();
+                    frame.node->append_kid(result);
+                    m_operands.push_back(frame.node);
+                    // nothing can follow an assignment inside its A
+                    state = FRAME_END;
+                    break;
+            }
         }
     }
-
-    // T' -> ^ epsilon
-    // No more multiplicative operators, so just return the completed AST
-
-    return ast.release();
 }
 
-Node *Parser2::parse_F() {
-    // F -> ^ number
-    // F -> ^ ident
-    // F -> ^ ident ( OptArgList )     -- function call
-    // F -> ^ ( A )
-    // F -> string_literal
-
-    Node *next_tok = m_lexer->peek();
-    Node *next_next_tok = m_lexer->peek(2);
-    if (next_tok == nullptr) {
-        error_at_current_loc("Unexpected end of input looking for primary expression");
-    }
-
-    int tag = next_tok->get_tag();
-    if (tag == TOK_INTEGER_LITERAL || tag == TOK_IDENTIFIER || tag == TOK_STRING) {
-        // F -> ^ number
-        // F -> ^ ident
-        // F -> string_literal
-        std::unique_ptr<Node> tok(expect(static_cast<enum TokenKind>(tag)));
-        std::unique_ptr<Node> ast(new Node(tok_to_ast(static_cast<TokenKind>(tag))));
-        ast->set_str(tok->get_str());
-        ast->set_loc(tok->get_loc());
-        if (next_next_tok->get_tag() == TOK_LPAREN) {
-            // F -> ident ^ ( OptArgList )     -- function call
-            expect_and_discard(TOK_LPAREN);
-            ast->append_kid(parse_OptArgList());
-            expect_and_discard(TOK_RPAREN);
-            return ast.release();
-        }
-        return ast.release();
-    } else if (tag == TOK_LPAREN) {
-        // F -> ^ ( A )
-        expect_and_discard(TOK_LPAREN);
-        std::unique_ptr<Node> ast(parse_A());
-        expect_and_discard(TOK_RPAREN);
-        return ast.release();
+// Replace the top two operands with the top operator applied to them.
+void Parser2::reduce() {
+    PendingOp pending = m_operators.back();
+    m_operators.pop_back();
+    Node *rhs = m_operands.back();
+    m_operands.pop_back();
+    Node *lhs = m_operands.back();
+
+    Node *ast;
+    if (pending.op->keep_lexeme) {
+        ast = m_arena->make<Node>(pending.op->ast, m_lexer->get_str(pending.tok));
     } else {
-        SyntaxError::raise(next_tok->get_loc(), "Invalid primary expression");
+        ast = m_arena->make<Node>(pending.op->ast);
     }
-}
-
-Node *Parser2::parse_assign() {
-    // A  → ^ ident = A
-
-    Node *lhs = parse_ident();
-    expect_and_discard(TOK_ASSIGN);
-    // A    → ident = ^ A
-
-    Node *rhs = parse_A();
-
-    std::unique_ptr<Node> ast(new Node(AST_ASSIGN));
-    ast->set_loc(lhs->get_loc());
-    ast->set_str("=");
+    ast->set_loc(m_lexer->get_loc(pending.tok));
     ast->append_kid(lhs);
     ast->append_kid(rhs);
-    return ast.release();
+    m_operands.back() = ast;
 }
 
 Node *Parser2::parse_var() {
     // STMT -> ^ var ident;
 
-    std::unique_ptr<Node> tok(expect(static_cast<enum TokenKind>(TOK_VAR)));
-    std::unique_ptr<Node> ast(new Node(AST_VARDEF));
-    ast->set_str(tok->get_str());
-    ast->set_loc(tok->get_loc());
+    Node *ast = token_to_node(AST_VARDEF, expect(TOK_VAR));
     ast->append_kid(parse_ident());
 
-    return ast.release();
+    return ast;
 }
 
 
 Node *Parser2::parse_ident() {
     // STMT -> var ^ ident;
 
-    std::unique_ptr<Node> tok(expect(static_cast<enum TokenKind>(TOK_IDENTIFIER)));
-    std::unique_ptr<Node> ast(new Node(AST_VARREF));
-    ast->set_str(tok->get_str());
-    ast->set_loc(tok->get_loc());
-    return ast.release();
+    return token_to_node(AST_VARREF, expect(TOK_IDENTIFIER));
 
 }
 
 Node *Parser2::parse_if() {
     // Read and create an IF statement
-    std::unique_ptr<Node> tok(expect(static_cast<enum TokenKind>(TOK_IF)));
-    std::unique_ptr<Node> ast(new Node(AST_IF));
-    ast->set_str(tok->get_str());
-    ast->set_loc(tok->get_loc());
-    return ast.release();
+    return token_to_node(AST_IF, expect(TOK_IF));
 }
 
 
 Node *Parser2::parse_while() {
     // read and create While Statement
-    std::unique_ptr<Node> tok(expect(static_cast<enum TokenKind>(TOK_WHILE)));
-    std::unique_ptr<Node> ast(new Node(AST_WHILE));
-    ast->set_str(tok->get_str());
-    ast->set_loc(tok->get_loc());
-    return ast.release();
+    return token_to_node(AST_WHILE, expect(TOK_WHILE));
 }
 
 Node *Parser2::parse_function() {
-    std::unique_ptr<Node> tok(expect(static_cast<enum TokenKind>(TOK_FN)));
-    std::unique_ptr<Node> ast(new Node(AST_FUNCTION));
-    ast->set_loc(tok->get_loc());
-    return ast.release();
+    Token tok = expect(TOK_FN);
+    Node *ast = m_arena->make<Node>(AST_FUNCTION);
+    ast->set_loc(m_lexer->get_loc(tok));
+    return ast;
 }
 
 
-Node *Parser2::expect(enum TokenKind tok_kind) {
-    std::unique_ptr<Node> next_terminal(m_lexer->next());
-    if (next_terminal == nullptr) {
-        SyntaxError::raise(next_terminal->get_loc(), "Unexpected end of input, wanted %u", tok_kind);
-    } else if (next_terminal->get_tag() != tok_kind) {
-        SyntaxError::raise(next_terminal->get_loc(), "Unexpected token '%s'", next_terminal->get_str().c_str());
+Token Parser2::expect(enum TokenKind tok_kind) {
+    Token next_terminal = m_lexer->next();
+    if (next_terminal.get_kind() != tok_kind) {
+        SyntaxError::raise(m_lexer->get_loc(next_terminal), "Unexpected token '%s'",
+                           m_lexer->get_str(next_terminal).c_str());
     }
 
-    return next_terminal.release();
+    return next_terminal;
 }
 
 void Parser2::expect_and_discard(enum TokenKind tok_kind) {
-    Node *tok = expect(tok_kind);
-    delete tok;
+    expect(tok_kind);
+}
+
+// Create an AST node for a token the parser keeps, copying its
+// lexeme and location.
+Node *Parser2::token_to_node(int ast_tag, const Token &tok) {
+    Node *ast;
+    if (tok.sym != NO_SYMBOL) {
+        // identifiers keep only their Symbol
+        ast = m_arena->make<Node>(ast_tag);
+        ast->set_sym(tok.sym);
+    } else {
+        ast = m_arena->make<Node>(ast_tag, m_lexer->get_str(tok));
+    }
+    ast->set_loc(m_lexer->get_loc(tok));
+    return ast;
+}
+
+DeferredBody::DeferredBody(Arena *arena, const SourceSpan &span)
+        : Node(arena, AST_DEFERRED_BODY), m_span(span), m_body(nullptr) {
+}
+
+Node *DeferredBody::get_body() {
+    if (m_body == nullptr) {
+        // the body goes in the same arena as the rest of the function
+        m_body = parse(get_arena());
+        // the source text is no longer needed
+        m_span = SourceSpan();
+    }
+    return m_body;
+}
+
+Node *DeferredBody::parse(Arena *arena) const {
+    Parser2 parser(new Lexer(m_span), arena);
+    Node *body = parser.parse_SList();
+    parser.expect_and_discard(TOK_RBRACE);
+    return body;
 }
 
 void Parser2::error_at_current_loc(const std::string &msg) {
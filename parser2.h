@@ -1,45 +1,108 @@
 #ifndef PARSER2_H
 #define PARSER2_H
 
+#include <vector>
 #include "lexer.h"
 #include "node.h"
 #include "ast.h"
 
+class Arena;
+
+// Placeholder for a function body that hasn't been parsed yet
+// (see Parser2::set_lazy_functions). The body is parsed the first
+// time get_body() is called, and kept for later calls. The parsed body
+// is allocated in the same Arena as the placeholder.
+class DeferredBody : public Node {
+private:
+    SourceSpan m_span;
+    Node *m_body;
+
+public:
+    DeferredBody(Arena *arena, const SourceSpan &span);
+
+    // Get the parsed statement list.
+    // Throws SyntaxError if the body is not valid.
+    Node *get_body();
+
+    // Parse the body into the given arena, without keeping the result.
+    // Several threads may parse different bodies at once, as long as
+    // each uses its own arena.
+    Node *parse(Arena *arena) const;
+};
+
 class Parser2 {
 private:
     Lexer *m_lexer;
-    Node *m_next;
+    Arena *m_arena;
+    bool m_lazy_functions;
+    bool m_started;
+    int m_num_threads;
+    // while parse_parallel() is pre-scanning, where skip_body()
+    // records the function bodies it skips
+    std::vector<DeferredBody *> *m_deferred;
+
+    // parse_expression() state, kept here so the storage is reused
+    struct ExprFrame;
+    struct PendingOp;
+    std::vector<ExprFrame> m_frames;
+    std::vector<Node *> m_operands;
+    std::vector<PendingOp> m_operators;
+
+    friend class DeferredBody;
 
 public:
-    Parser2(Lexer *lexer_to_adopt);
+    // Nodes are allocated in the given arena, which the caller owns
+    // and must keep alive as long as the AST is in use.
+    Parser2(Lexer *lexer_to_adopt, Arena *arena);
 
     ~Parser2();
 
+    // Allocate nodes parsed from now on in a different arena.
+    void set_arena(Arena *arena) { m_arena = arena; }
+
     Node *parse();
 
+    // Parse the input one top-level statement (TStmt) at a time,
+    // returning nullptr once the input is used up. As with parse(),
+    // the input must contain at least one statement.
+    Node *parse_next();
+
+    // Whether the next statement parse_next() returns is a function
+    // definition, so the caller can choose the arena it goes in.
+    bool at_function();
+
+    // In lazy mode, function bodies are only brace-matched when the
+    // function is defined, and are parsed the first time they're
+    // needed. Syntax errors in a function that is never called are
+    // not reported.
+    void set_lazy_functions(bool lazy) { m_lazy_functions = lazy; }
+
+    // Let parse() parse function bodies on up to num_threads threads.
+    // The AST and any syntax error reported are the same as when
+    // parsing on one thread. Has no effect in lazy mode.
+    void set_num_threads(int num_threads) { m_num_threads = num_threads; }
+
 private:
     // Parse functions for nonterminal grammar symbols
     Node *parse_Unit();
 
+    Node *parse_parallel();
+
     Node *parse_Stmt();
 
     Node *parse_TStmt();
 
-    Node *parse_E();
-
-    Node *parse_EPrime(Node *ast);
-
-    Node *parse_T();
+    Node *parse_Func();
 
-    Node *parse_TPrime(Node *ast);
+    Node *parse_import();
 
-    Node *parse_F();
+    Node *skip_body(const Token &lbrace);
 
-    Node *parse_Func();
+    Node *defer_body(const Token &lbrace);
 
 
-    // Consume a specific token, wrapping it in a Node
-    Node *expect(enum TokenKind tok_kind);
+    // Consume a specific token
+    Token expect(enum TokenKind tok_kind);
 
     // Consume a specific token and discard it
     void expect_and_discard(enum TokenKind tok_kind);
@@ -49,11 +112,11 @@ private:
 
     // Parse functions for Math
 
-    Node *parse_L();
-
     Node *parse_A();
 
-    Node *parse_R();
+    Node *parse_expression();
+
+    void reduce();
 
     // Parse functions for terminals
 
@@ -65,8 +128,6 @@ private:
 
     Node *parse_while();
 
-    Node *parse_assign();
-
 
     // Parse functions for Lists
 
@@ -76,21 +137,15 @@ private:
 
     // Parse functions for functions
 
-    Node *parse_OptArgList();
-
-    Node *parse_ArgList(Node *arg_list_);
-
     Node *parse_function();
 
     Node *parse_SList();
 
 
-    // Helper function
+    // Helper functions
     ASTKind tok_to_ast(TokenKind tag);
 
-    static bool valid_operand(int tok);
-
-
+    Node *token_to_node(int ast_tag, const Token &tok);
 };
 
 #endif // PARSER2_H
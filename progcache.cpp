@@ -0,0 +1,109 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "source_buffer.h"
+#include "flat_ast.h"
+#include "progcache.h"
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'M', 'L', 'C', 'A', 'C', 'H', 'E', '\n'};
+
+// Fixed part of a cache entry; the FlatAST image follows it.
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;   // sizeof(FlatNode), guarding against layout changes
+    uint64_t source_hash;
+    uint64_t source_size; // hash collisions would also have to match this
+    uint64_t image_hash;  // of the FlatAST image, to catch damaged entries
+};
+
+// 64-bit FNV-1a
+uint64_t hash_bytes(const char *p, const char *end, uint64_t h = 14695981039346656037ull) {
+    for (; p != end; p++) {
+        h = (h ^ uint8_t(*p)) * 1099511628211ull;
+    }
+    return h;
+}
+
+CacheHeader make_header(const SourceBuffer &src, uint64_t hash) {
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.node_size = uint32_t(sizeof(FlatNode));
+    header.source_hash = hash;
+    header.source_size = src.size();
+    header.image_hash = 0;
+    return header;
+}
+
+}
+
+ProgramCache::ProgramCache(const std::string &dir, const SourceBuffer &src)
+        : m_dir(dir), m_src(src), m_hash(hash_bytes(src.begin(), src.end())) {
+}
+
+FlatAST *ProgramCache::load(FileId main_file) const {
+    FILE *in = fopen(get_path().c_str(), "r");
+    if (!in) {
+        return nullptr;
+    }
+    // mapped, if the cache is on a regular file system
+    std::unique_ptr<SourceBuffer> image;
+    try {
+        image.reset(new SourceBuffer(in));
+    } catch (...) {
+        fclose(in);
+        return nullptr;
+    }
+    fclose(in);
+
+    CacheHeader expected = make_header(m_src, m_hash), header;
+    if (image->size() < sizeof(header)) {
+        return nullptr;
+    }
+    memcpy(&header, image->begin(), sizeof(header));
+    expected.image_hash = hash_bytes(image->begin() + sizeof(header), image->end());
+    if (memcmp(&header, &expected, sizeof(header)) != 0) {
+        return nullptr;
+    }
+    return FlatAST::read_image(image->begin() + sizeof(header), image->size() - sizeof(header), main_file);
+}
+
+void ProgramCache::store(const FlatAST &prog, FileId main_file) const {
+    CacheHeader header = make_header(m_src, m_hash);
+    std::string image(sizeof(header), '\0');
+    prog.write_image(image, main_file);
+    header.image_hash = hash_bytes(image.data() + sizeof(header), image.data() + image.size());
+    memcpy(&image[0], &header, sizeof(header));
+
+    if (mkdir(m_dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        return;
+    }
+    // write to a private name first, so other processes never see a
+    // partial entry
+    std::string path = get_path();
+    std::string tmp_path = path + "." + std::to_string(getpid()) + ".tmp";
+    FILE *out = fopen(tmp_path.c_str(), "w");
+    if (!out) {
+        return;
+    }
+    bool ok = fwrite(image.data(), 1, image.size(), out) == image.size();
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+    }
+}
+
+std::string ProgramCache::get_path() const {
+    // the version is part of the name, so entries from different
+    // interpreter versions don't replace each other
+    char name[64];
+    snprintf(name, sizeof(name), "/%016llx-v%u.mlc", (unsigned long long) m_hash,
+             unsigned(PROGRAM_CACHE_VERSION));
+    return m_dir + name;
+}
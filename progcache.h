@@ -0,0 +1,50 @@
+#ifndef PROGCACHE_H
+#define PROGCACHE_H
+
+#include <cstdint>
+#include <string>
+#include "location.h"
+
+class SourceBuffer;
+
+class FlatAST;
+
+// Interpreter version recorded in cached programs. Bump it whenever a
+// change (to the AST, FlatAST, semantic analysis, ...) would make
+// programs compiled by an older build wrong for this one.
+const uint32_t PROGRAM_CACHE_VERSION = 6;
+
+// On-disk cache of analyzed programs, so running the same script again
+// skips lexing, parsing and analysis. Entries are FlatAST images named
+// after a hash of the source text and PROGRAM_CACHE_VERSION, so an
+// edited script or a new interpreter simply misses. Entries are written
+// to a temporary file and renamed into place, so several processes can
+// share a cache directory.
+class ProgramCache {
+private:
+    std::string m_dir;
+    const SourceBuffer &m_src;
+    uint64_t m_hash;
+
+    // copy constructor and assignment operator prohibited
+    ProgramCache(const ProgramCache &);
+
+    ProgramCache &operator=(const ProgramCache &);
+
+public:
+    // Look up the program in src in the given directory.
+    ProgramCache(const std::string &dir, const SourceBuffer &src);
+
+    // Get the cached program, or nullptr if there is no usable entry
+    // (missing, stale, or damaged). main_file is the file being run.
+    FlatAST *load(FileId main_file) const;
+
+    // Add the compiled program to the cache. Failing to write the
+    // cache is not an error: the program just isn't cached.
+    void store(const FlatAST &prog, FileId main_file) const;
+
+private:
+    std::string get_path() const;
+};
+
+#endif // PROGCACHE_H
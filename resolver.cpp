@@ -0,0 +1,224 @@
+#include "ast.h"
+#include "node.h"
+#include "resolver.h"
+
+ScopeResolver::ScopeResolver()
+        : m_level(0), m_next_slot(0), m_num_slots(0) {
+}
+
+void ScopeResolver::resolve_unit(Node *unit) {
+    for (unsigned i = 0; i < unit->get_num_kids(); i++) {
+        resolve_top_level(unit->get_kid(i));
+    }
+}
+
+void ScopeResolver::resolve_top_level(Node *stmt) {
+    switch (stmt->get_tag()) {
+        case AST_FUNCTION: {
+            declare(stmt->get_kid(0));
+            Node *body = stmt->get_kid(2);
+            if (body->get_tag() != AST_DEFERRED_BODY) {
+                std::vector<Symbol> params;
+                for (unsigned i = 0; i < stmt->get_kid(1)->get_num_kids(); i++) {
+                    params.push_back(stmt->get_kid(1)->get_kid(i)->get_sym());
+                }
+                resolve_function(params, body);
+            }
+            break;
+        }
+        case AST_IMPORT:
+            break;
+        default:
+            resolve_statement(stmt);
+            break;
+    }
+}
+
+void ScopeResolver::resolve_function(const std::vector<Symbol> &params, Node *body) {
+    begin_frame();
+
+    // the parameters take the first slots, in order, in a scope of
+    // their own that the body's block is nested in
+    open_block();
+    for (size_t i = 0; i < params.size(); i++) {
+        auto old = m_locals.find(params[i]);
+        m_shadowed.push_back({params[i], old != m_locals.end() ? old->second : Local{-1, -1}});
+        m_locals[params[i]] = Local{int(i), int(m_blocks.size())};
+    }
+    m_next_slot = m_num_slots = int(params.size());
+
+    resolve_block(body);
+    close_block();
+    end_frame(body, int(params.size()));
+}
+
+void ScopeResolver::resolve_statement(Node *stmt) {
+    switch (stmt->get_tag()) {
+        case AST_STATEMENT:
+            resolve_statement(stmt->get_kid(0));
+            break;
+        case AST_VARDEF:
+            declare(stmt->get_last_kid());
+            break;
+        case AST_IF:
+        case AST_WHILE:
+            resolve_expression(stmt->get_kid(0));
+            for (unsigned i = 1; i < stmt->get_num_kids(); i++) {
+                resolve_block(stmt->get_kid(i));
+            }
+            break;
+        default:
+            resolve_expression(stmt);
+            break;
+    }
+}
+
+void ScopeResolver::resolve_block(Node *list) {
+    // a block at the top level gets a frame of its own
+    bool new_frame = m_level == 0;
+    if (new_frame) {
+        begin_frame();
+    }
+
+    open_block();
+    for (unsigned i = 0; i < list->get_num_kids(); i++) {
+        resolve_statement(list->get_kid(i));
+    }
+    close_block();
+
+    if (new_frame) {
+        end_frame(list, 0);
+    }
+}
+
+void ScopeResolver::resolve_expression(Node *expr) {
+    // expressions can nest deeply, so don't recurse
+    std::vector<Node *> pending(1, expr);
+    while (!pending.empty()) {
+        Node *n = pending.back();
+        pending.pop_back();
+        if (n->get_tag() == AST_VARREF) {
+            auto i = m_locals.find(n->get_sym());
+            if (i != m_locals.end()) {
+                n->set_scope(ScopeInfo(0, i->second.slot));
+                m_local_refs.push_back(n);
+            } else {
+                n->set_scope(ScopeInfo(m_level, ScopeInfo::GLOBAL));
+            }
+        } else if (n->get_tag() == AST_ASSIGN && m_level > 0) {
+            m_local_assigns.push_back(n);
+        }
+        pending.insert(pending.end(), n->cbegin(), n->cend());
+    }
+}
+
+void ScopeResolver::declare(Node *name) {
+    if (m_level == 0) {
+        name->set_scope(ScopeInfo(0, ScopeInfo::GLOBAL));
+        return;
+    }
+
+    Symbol sym = name->get_sym();
+    int block = int(m_blocks.size());
+    auto old = m_locals.find(sym);
+    if (old != m_locals.end() && old->second.block == block) {
+        name->set_scope(ScopeInfo(0, ScopeInfo::REDECLARED));
+        return;
+    }
+
+    m_shadowed.push_back({sym, old != m_locals.end() ? old->second : Local{-1, -1}});
+    int slot = m_next_slot++;
+    if (m_next_slot > m_num_slots) {
+        m_num_slots = m_next_slot;
+    }
+    m_locals[sym] = Local{slot, block};
+    name->set_scope(ScopeInfo(0, slot));
+}
+
+void ScopeResolver::begin_frame() {
+    m_level++;
+    m_next_slot = m_num_slots = 0;
+}
+
+void ScopeResolver::end_frame(Node *body, int num_params) {
+    body->set_scope(ScopeInfo(0, ScopeInfo::UNRESOLVED, m_num_slots));
+
+    // find the slots only ever assigned ints (parameters can hold
+    // anything)
+    std::vector<bool> int_slots(size_t(m_num_slots), true);
+    for (int i = 0; i < num_params; i++) {
+        int_slots[size_t(i)] = false;
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (Node *assign : m_local_assigns) {
+            int slot = assign->get_kid(0)->get_scope().slot;
+            if (slot >= 0 && int_slots[size_t(slot)] && !is_int(assign->get_kid(1), int_slots)) {
+                int_slots[size_t(slot)] = false;
+                changed = true;
+            }
+        }
+    }
+
+    for (Node *ref : m_local_refs) {
+        ScopeInfo scope = ref->get_scope();
+        scope.always_int = int_slots[size_t(scope.slot)];
+        ref->set_scope(scope);
+    }
+    m_local_refs.clear();
+    m_local_assigns.clear();
+    m_level--;
+}
+
+// Whether an expression always produces an int (if it produces a value
+// at all), given which slots of the frame always hold ints.
+bool ScopeResolver::is_int(Node *expr, const std::vector<bool> &int_slots) {
+    for (;;) {
+        switch (expr->get_tag()) {
+            case AST_INT_LITERAL:
+            case AST_ADD:
+            case AST_SUB:
+            case AST_MULTIPLY:
+            case AST_DIVIDE:
+            case AST_AND:
+            case AST_OR:
+            case AST_LESS:
+            case AST_LESSEQUAL:
+            case AST_GREATER:
+            case AST_GREATEREQUAL:
+            case AST_EQUAL:
+            case AST_NOTEQUAL:
+                return true;
+            case AST_ASSIGN:
+                // an assignment produces the value assigned
+                expr = expr->get_kid(1);
+                break;
+            case AST_VARREF: {
+                int slot = expr->get_scope().slot;
+                return expr->get_num_kids() == 0 && slot >= 0 && int_slots[size_t(slot)];
+            }
+            default:
+                return false;
+        }
+    }
+}
+
+void ScopeResolver::open_block() {
+    m_blocks.push_back({m_shadowed.size(), m_next_slot});
+}
+
+void ScopeResolver::close_block() {
+    // the block's locals go out of scope, and their slots can be reused
+    size_t first = m_blocks.back().first;
+    while (m_shadowed.size() > first) {
+        const std::pair<Symbol, Local> &entry = m_shadowed.back();
+        if (entry.second.slot < 0) {
+            m_locals.erase(entry.first);
+        } else {
+            m_locals[entry.first] = entry.second;
+        }
+        m_shadowed.pop_back();
+    }
+    m_next_slot = m_blocks.back().second;
+    m_blocks.pop_back();
+}
@@ -0,0 +1,92 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "symtab.h"
+
+class Node;
+
+// Works out where each variable of an AST lives, so the interpreter
+// doesn't have to look variables up by name. The results are stored
+// in each node's ScopeInfo (see node_base.h).
+//
+// Global variables (those declared at the top level, functions and
+// intrinsics) stay in the global frame, where they are found by
+// Symbol: they are defined as the program runs, so whether one exists
+// can only be checked then. Local variables are numbered: each
+// function call, and each block at the top level, gets a frame with
+// one slot per local variable of its blocks (blocks that can't be
+// active at the same time share slots). A name refers to the
+// innermost declaration before it in an enclosing block, as it did
+// when each block had an Environment of its own.
+//
+// Once a frame has been resolved, the resolver also works out which of
+// its variables always hold ints, so the interpreter can use them
+// without checking. Every variable starts out as an int (a declaration
+// sets it to 0), so one only ever holds something else if it is a
+// parameter or something else is assigned to it. Since operators only
+// produce ints, this is usually easy to rule out: the variables of a
+// frame are assumed to be ints until an assignment of a value that
+// might not be an int (e.g. the result of a call, or a variable
+// already found not to be an int) shows otherwise. A slot shared by
+// variables of different blocks is only an int if all of them are.
+class ScopeResolver {
+private:
+    // a local variable: its slot, and the nesting level of the block
+    // declaring it
+    struct Local {
+        int slot, block;
+    };
+
+    // frames between the code being resolved and the global frame
+    int m_level;
+    // locals in scope at this point
+    std::unordered_map<Symbol, Local> m_locals;
+    // for each local declared in an open block, what its name meant
+    // before (a slot of -1 if nothing)
+    std::vector<std::pair<Symbol, Local>> m_shadowed;
+    // for each open block, the size of m_shadowed and the next free
+    // slot when it was opened
+    std::vector<std::pair<size_t, int>> m_blocks;
+    int m_next_slot, m_num_slots;
+    // in the current frame, the references to its variables and the
+    // assignments to them
+    std::vector<Node *> m_local_refs, m_local_assigns;
+
+public:
+    ScopeResolver();
+
+    // Resolve the variables of a program or module.
+    void resolve_unit(Node *unit);
+
+    // Resolve one top-level statement (TStmt) of a unit. The body of a
+    // function whose parsing was deferred is left for later.
+    void resolve_top_level(Node *stmt);
+
+    // Resolve the body of a function, e.g. one whose parsing was
+    // deferred, given its parameters.
+    void resolve_function(const std::vector<Symbol> &params, Node *body);
+
+private:
+    void resolve_statement(Node *stmt);
+
+    void resolve_block(Node *list);
+
+    void resolve_expression(Node *expr);
+
+    void declare(Node *name);
+
+    void open_block();
+
+    void close_block();
+
+    void begin_frame();
+
+    void end_frame(Node *body, int num_params);
+
+    static bool is_int(Node *expr, const std::vector<bool> &int_slots);
+};
+
+#endif // RESOLVER_H
@@ -0,0 +1,170 @@
+#include <cctype>
+#if defined(__AVX2__) || defined(__SSE2__)
+#  include <immintrin.h>
+#endif
+#include "scan.h"
+
+namespace {
+
+bool is_space(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool is_alnum(unsigned char c) {
+    return (unsigned char) ((c | 0x20) - 'a') < 26 || (unsigned char) (c - '0') < 10;
+}
+
+bool is_digit(unsigned char c) {
+    return (unsigned char) (c - '0') < 10;
+}
+
+bool is_quote_or_escape(unsigned char c) {
+    return c == '"' || c == '\\';
+}
+
+#if defined(__AVX2__)
+
+// AVX2: 32 bytes per step
+typedef __m256i Vec;
+const int VEC_SIZE = 32;
+
+inline Vec load(const char *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+
+inline Vec splat(char c) { return _mm256_set1_epi8(c); }
+
+inline Vec eq(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+
+inline Vec gt(Vec a, Vec b) { return _mm256_cmpgt_epi8(a, b); }
+
+inline Vec v_and(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+
+inline Vec v_or(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+
+inline unsigned mask(Vec v) { return unsigned(_mm256_movemask_epi8(v)); }
+
+const unsigned ALL_SET = 0xFFFFFFFFu;
+
+#elif defined(__SSE2__)
+
+// SSE2: 16 bytes per step
+typedef __m128i Vec;
+const int VEC_SIZE = 16;
+
+inline Vec load(const char *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+
+inline Vec splat(char c) { return _mm_set1_epi8(c); }
+
+inline Vec eq(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+
+inline Vec gt(Vec a, Vec b) { return _mm_cmpgt_epi8(a, b); }
+
+inline Vec v_and(Vec a, Vec b) { return _mm_and_si128(a, b); }
+
+inline Vec v_or(Vec a, Vec b) { return _mm_or_si128(a, b); }
+
+inline unsigned mask(Vec v) { return unsigned(_mm_movemask_epi8(v)); }
+
+const unsigned ALL_SET = 0xFFFFu;
+
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#  define SCAN_HAVE_SIMD 1
+
+// Byte-wise lo <= v <= hi. The comparisons are signed, which is fine
+// for the ASCII ranges used here: bytes >= 0x80 are negative and so
+// never fall inside them.
+inline Vec in_range(Vec v, char lo, char hi) {
+    return v_and(gt(v, splat(char(lo - 1))), gt(splat(char(hi + 1)), v));
+}
+
+inline Vec space_class(Vec v) {
+    return v_or(eq(v, splat(' ')), in_range(v, '\t', '\r'));
+}
+
+inline Vec alnum_class(Vec v) {
+    return v_or(in_range(v_or(v, splat(0x20)), 'a', 'z'), in_range(v, '0', '9'));
+}
+
+inline Vec digit_class(Vec v) {
+    return in_range(v, '0', '9');
+}
+
+inline Vec quote_or_escape_class(Vec v) {
+    return v_or(eq(v, splat('"')), eq(v, splat('\\')));
+}
+
+// Skip while classify() holds for each byte (or, if invert is set,
+// while it does not hold), finishing the tail with the scalar predicate.
+template<Vec (*classify)(Vec), bool (*pred)(unsigned char), bool invert>
+const char *skip_while(const char *p, const char *end) {
+    while (end - p >= VEC_SIZE) {
+        unsigned m = mask(classify(load(p)));
+        if (invert) {
+            m = ~m & ALL_SET;
+        }
+        if (m != ALL_SET) {
+            return p + __builtin_ctz(~m);
+        }
+        p += VEC_SIZE;
+    }
+    while (p != end && pred((unsigned char) *p) != invert) {
+        p++;
+    }
+    return p;
+}
+
+#endif
+
+template<bool (*pred)(unsigned char)>
+const char *skip_scalar(const char *p, const char *end) {
+    while (p != end && pred((unsigned char) *p)) {
+        p++;
+    }
+    return p;
+}
+
+}
+
+const char *scan::skip_space(const char *p, const char *end) {
+#ifdef SCAN_HAVE_SIMD
+    return skip_while<space_class, is_space, false>(p, end);
+#else
+    return skip_scalar<is_space>(p, end);
+#endif
+}
+
+const char *scan::skip_alnum(const char *p, const char *end) {
+#ifdef SCAN_HAVE_SIMD
+    return skip_while<alnum_class, is_alnum, false>(p, end);
+#else
+    return skip_scalar<is_alnum>(p, end);
+#endif
+}
+
+const char *scan::skip_digits(const char *p, const char *end) {
+#ifdef SCAN_HAVE_SIMD
+    return skip_while<digit_class, is_digit, false>(p, end);
+#else
+    return skip_scalar<is_digit>(p, end);
+#endif
+}
+
+const char *scan::skip_punct(const char *p, const char *end) {
+    // punctuation tokens are at most a few characters long
+    while (p != end && ispunct((unsigned char) *p)) {
+        p++;
+    }
+    return p;
+}
+
+const char *scan::find_quote_or_escape(const char *p, const char *end) {
+#ifdef SCAN_HAVE_SIMD
+    return skip_while<quote_or_escape_class, is_quote_or_escape, true>(p, end);
+#else
+    while (p != end && !is_quote_or_escape((unsigned char) *p)) {
+        p++;
+    }
+    return p;
+#endif
+}
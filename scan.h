@@ -0,0 +1,31 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// Bulk character-class scanning used by the Lexer.
+// Each function takes a half-open range [p, end) and returns a pointer
+// to the first character that does NOT belong to the class being
+// skipped (or end if the whole range matches). When the compiler
+// targets SSE2 or AVX2, 16 or 32 bytes are classified at a time;
+// otherwise a scalar loop is used.
+
+namespace scan {
+
+// whitespace, as classified by isspace() in the "C" locale
+const char *skip_space(const char *p, const char *end);
+
+// [A-Za-z0-9], as classified by isalnum() in the "C" locale
+const char *skip_alnum(const char *p, const char *end);
+
+// [0-9]
+const char *skip_digits(const char *p, const char *end);
+
+// punctuation, as classified by ispunct() in the "C" locale
+const char *skip_punct(const char *p, const char *end);
+
+// Find the first '"' or '\\' (the characters that end a run of
+// plain string literal text).
+const char *find_quote_or_escape(const char *p, const char *end);
+
+}
+
+#endif // SCAN_H
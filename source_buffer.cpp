@@ -0,0 +1,75 @@
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "exceptions.h"
+#include "source_buffer.h"
+
+namespace {
+// size of each read() when the input can't be mapped
+const size_t READ_CHUNK_SIZE = 1 << 20;
+}
+
+SourceBuffer::SourceBuffer(FILE *in)
+        : m_data(""), m_size(0), m_mapped(false) {
+    int fd = fileno(in);
+    if (!try_map(fd)) {
+        read_all(fd);
+    }
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (m_mapped) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+}
+
+// Map the input if it is a non-empty regular file positioned at its start.
+// Returns false if the caller should fall back to reading it.
+bool SourceBuffer::try_map(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        return false;
+    }
+    if (lseek(fd, 0, SEEK_CUR) != 0) {
+        return false;
+    }
+
+    void *p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    // the lexer reads front to back exactly once
+    madvise(p, size_t(st.st_size), MADV_SEQUENTIAL);
+
+    m_data = static_cast<const char *>(p);
+    m_size = size_t(st.st_size);
+    m_mapped = true;
+    return true;
+}
+
+void SourceBuffer::read_all(int fd) {
+    size_t used = 0;
+    for (;;) {
+        if (m_storage.size() - used < READ_CHUNK_SIZE) {
+            m_storage.resize(used + READ_CHUNK_SIZE);
+        }
+        ssize_t n = read(fd, m_storage.data() + used, READ_CHUNK_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            RuntimeError::raise("Could not read input: %s", strerror(errno));
+        }
+        if (n == 0) {
+            break;
+        }
+        used += size_t(n);
+    }
+    m_storage.resize(used);
+    if (used > 0) {
+        m_data = m_storage.data();
+        m_size = used;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef SOURCE_BUFFER_H
+#define SOURCE_BUFFER_H
+
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+
+// The complete text of one source file, held in memory so the Lexer
+// can scan it with a plain pointer instead of going through stdio
+// a character at a time. Regular files are mapped with mmap; anything
+// else (pipes, terminals) is read in large chunks.
+class SourceBuffer {
+private:
+    const char *m_data;
+    size_t m_size;
+    bool m_mapped;
+    std::vector<char> m_storage;
+
+    // copy constructor and assignment operator prohibited
+    SourceBuffer(const SourceBuffer &);
+
+    SourceBuffer &operator=(const SourceBuffer &);
+
+public:
+    // Load the entire contents of the given stream.
+    // Throws RuntimeError if the input can't be read.
+    explicit SourceBuffer(FILE *in);
+
+    ~SourceBuffer();
+
+    const char *begin() const { return m_data; }
+
+    const char *end() const { return m_data + m_size; }
+
+    size_t size() const { return m_size; }
+
+private:
+    bool try_map(int fd);
+
+    void read_all(int fd);
+};
+
+#endif // SOURCE_BUFFER_H
@@ -0,0 +1,75 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one
+// consumer thread. The producer and consumer indices live on separate
+// cache lines, and each side keeps a cached copy of the other side's
+// index so the shared counters are only re-read when the queue looks
+// full (producer) or empty (consumer).
+template<typename T>
+class SpscQueue {
+private:
+    static const size_t CACHE_LINE = 64;
+
+    std::vector<T> m_slots;
+    size_t m_mask;
+
+    // consumer side
+    alignas(CACHE_LINE) std::atomic<size_t> m_head;
+    size_t m_cached_tail;
+
+    // producer side
+    alignas(CACHE_LINE) std::atomic<size_t> m_tail;
+    size_t m_cached_head;
+
+    // copy constructor and assignment operator prohibited
+    SpscQueue(const SpscQueue &);
+
+    SpscQueue &operator=(const SpscQueue &);
+
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity)
+            : m_head(0), m_cached_tail(0), m_tail(0), m_cached_head(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+        m_slots.resize(size);
+        m_mask = size - 1;
+    }
+
+    // Producer only: returns false if the queue is full.
+    bool try_push(const T &item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cached_head == m_slots.size()) {
+            m_cached_head = m_head.load(std::memory_order_acquire);
+            if (tail - m_cached_head == m_slots.size()) {
+                return false;
+            }
+        }
+        m_slots[tail & m_mask] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only: returns false if the queue is empty.
+    bool try_pop(T &item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cached_tail) {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cached_tail) {
+                return false;
+            }
+        }
+        item = m_slots[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif // SPSC_QUEUE_H
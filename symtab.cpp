@@ -0,0 +1,49 @@
+#include <cassert>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include "symtab.h"
+
+namespace {
+
+// Names are stored in a deque so that the string_view keys of the
+// lookup map (which refer to them) stay valid as the table grows.
+// The lock allows the lexer to intern names on a different thread
+// from the one reading them.
+struct Table {
+    std::mutex lock;
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, Symbol> ids;
+};
+
+Table &table() {
+    static Table t;
+    return t;
+}
+
+}
+
+Symbol symtab::intern(const char *s, size_t len) {
+    Table &t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    auto i = t.ids.find(std::string_view(s, len));
+    if (i != t.ids.end()) {
+        return i->second;
+    }
+    Symbol sym = Symbol(t.names.size());
+    t.names.emplace_back(s, len);
+    t.ids.insert({std::string_view(t.names.back()), sym});
+    return sym;
+}
+
+Symbol symtab::intern(const std::string &name) {
+    return intern(name.data(), name.size());
+}
+
+const std::string &symtab::get_name(Symbol sym) {
+    Table &t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    assert(sym >= 0 && size_t(sym) < t.names.size());
+    return t.names[size_t(sym)];
+}
@@ -0,0 +1,31 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <cstddef>
+#include <string>
+
+// Global table of interned identifiers.
+// The Lexer interns each identifier it reads, so tokens, AST nodes,
+// and environments refer to names by a small integer Symbol, and
+// comparing two names is an integer comparison. Symbols are never
+// freed; names stay valid for the life of the process. The table may
+// be used from several threads at once.
+
+typedef int Symbol;
+
+const Symbol NO_SYMBOL = -1;
+
+namespace symtab {
+
+// Return the Symbol for the given name, adding it to the table
+// if it hasn't been seen before.
+Symbol intern(const char *s, size_t len);
+
+Symbol intern(const std::string &name);
+
+// Get the name of an interned Symbol.
+const std::string &get_name(Symbol sym);
+
+}
+
+#endif // SYMTAB_H
@@ -1,8 +1,11 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <cstdint>
+#include "symtab.h"
+
 // This header file defines the tags used for tokens (i.e., terminal
-// symbols in the grammar.)
+// symbols in the grammar), and the Token type the Lexer produces.
 
 enum TokenKind {
     TOK_IDENTIFIER,
@@ -33,6 +36,32 @@ enum TokenKind {
     TOK_GREATEREQUAL,
     TOK_EQUAL,
     TOK_NOTEQUAL,
+    TOK_IMPORT,
+};
+
+// A token is a small plain value: rather than holding a copy of its
+// lexeme, it records where the lexeme lies in the Lexer's source buffer
+// (use Lexer::get_str to retrieve it, and Lexer::get_loc for its Location).
+// Identifiers also carry their interned Symbol.
+struct Token {
+    uint32_t offset;   // position of the first character in the source
+    uint32_t length;   // number of source characters in the lexeme
+    uint32_t line;
+    uint32_t kind_col; // TokenKind in the low 8 bits, column in the rest
+    Symbol sym;        // for TOK_IDENTIFIER, otherwise NO_SYMBOL
+
+    static const uint32_t MAX_COL = 0xFFFFFF;
+
+    TokenKind get_kind() const { return TokenKind(kind_col & 0xFF); }
+
+    int get_line() const { return int(line); }
+
+    int get_col() const { return int(kind_col >> 8); }
+
+    static Token make(TokenKind kind, uint32_t offset, uint32_t length, int line, int col) {
+        uint32_t packed_col = uint32_t(col) < MAX_COL ? uint32_t(col) : MAX_COL;
+        return Token{offset, length, uint32_t(line), uint32_t(kind) | (packed_col << 8), NO_SYMBOL};
+    }
 };
 
 #endif // TOKEN_H
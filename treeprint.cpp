@@ -19,83 +19,271 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 
 #include <vector>
-#include <utility>
+#include <string>
+#include <unordered_map>
 #include <cstdio>
+#include <cstring>
+#include <cstdint>
 #include <cassert>
 #include "node.h"
+#include "flat_ast.h"
+#include "exceptions.h"
 #include "treeprint.h"
 
 namespace {
 
-// pair of (index, num siblings):
-// index is which sibling we're currently printing
-typedef std::pair<int, int> StackItem;
+// Output buffer, written out in large blocks
+class OutBuffer {
+private:
+  static const size_t CAPACITY = 1 << 20;
 
-struct TreePrintContext {
-  std::vector<StackItem> stack;
-  const TreePrint *tp_obj;
+  FILE *m_out;
+  std::vector<char> m_buf;
+  size_t m_used;
 
-  TreePrintContext(const TreePrint *tp_obj_)
-    : tp_obj(tp_obj_) { }
+public:
+  OutBuffer(FILE *out) : m_out(out), m_buf(CAPACITY), m_used(0) { }
+  ~OutBuffer() { }
 
-  void pushctx(int nsibs);
-  void popctx();
-  void print_node(Node *n);
+  void put(const char *s, size_t len) {
+    if (len > CAPACITY - m_used) {
+      flush();
+      if (len > CAPACITY) {
+        write(s, len);
+        return;
+      }
+    }
+    memcpy(m_buf.data() + m_used, s, len);
+    m_used += len;
+  }
+
+  void put(const std::string &s) { put(s.data(), s.size()); }
+  void put(const char *s) { put(s, strlen(s)); }
+  void put(char c) { put(&c, 1); }
+
+  void put_int(long val) {
+    char tmp[24];
+    put(tmp, size_t(snprintf(tmp, sizeof(tmp), "%ld", val)));
+  }
+
+  void put_varint(uint64_t val) {
+    while (val >= 0x80) {
+      put(char(val | 0x80));
+      val >>= 7;
+    }
+    put(char(val));
+  }
+
+  void put_signed(int64_t val) {
+    put_varint((uint64_t(val) << 1) ^ uint64_t(val >> 63));
+  }
+
+  void flush() {
+    write(m_buf.data(), m_used);
+    m_used = 0;
+  }
+
+private:
+  void write(const char *s, size_t len) {
+    if (len > 0 && fwrite(s, 1, len, m_out) != len) {
+      RuntimeError::raise("Could not write output");
+    }
+  }
 };
 
-void TreePrintContext::pushctx(int nsibs_) {
-  stack.push_back({ 0, nsibs_ });
-}
+class TreePrintContext {
+private:
+  // a node whose kids are being printed
+  template<typename NodeRef>
+  struct Frame {
+    NodeRef node;
+    unsigned next_kid;
+    bool is_last; // last kid of its parent
+  };
 
-void TreePrintContext::popctx() {
-  stack.pop_back();
-}
+  const TreePrint *m_tp;
+  OutBuffer m_out;
+  std::unordered_map<int, std::string> m_tag_names;
+
+  // BINARY tables
+  std::unordered_map<int, uint64_t> m_tag_index;
+  std::unordered_map<std::string, uint64_t> m_str_index;
+  int m_prev_line, m_prev_col;
+
+public:
+  TreePrintContext(const TreePrint *tp, FILE *out)
+    : m_tp(tp), m_out(out), m_prev_line(0), m_prev_col(0) { }
+
+  // NodeRef is either Node * or FlatNodeRef
+  template<typename NodeRef>
+  void print_tree(NodeRef root);
+
+private:
+  template<typename NodeRef>
+  void begin_node(const std::vector<Frame<NodeRef>> &path, NodeRef n, bool is_first);
+
+  void end_node(unsigned nkids);
 
-void TreePrintContext::print_node(Node *n) {
-  int depth = int(stack.size());
-  assert(depth > 0);
-  for (int i = 1; i < depth; i++) {
-    if (i == depth-1) {
-      printf("+--");
+  const std::string &tag_name(int tag);
+
+  void put_json_str(const std::string &s);
+
+  template<typename Map, typename Key>
+  void put_table_entry(Map &table, const Key &key, const std::string &value);
+};
+
+template<typename NodeRef>
+void TreePrintContext::print_tree(NodeRef root) {
+  if (m_tp->get_format() == TreePrint::BINARY) {
+    m_out.put("MLAST01\n");
+  }
+
+  std::vector<Frame<NodeRef>> path;
+  begin_node(path, root, true);
+  path.push_back({root, 0, true});
+  while (!path.empty()) {
+    Frame<NodeRef> &top = path.back();
+    unsigned nkids = top.node->get_num_kids();
+    if (top.next_kid == nkids) {
+      path.pop_back();
+      end_node(nkids);
     } else {
-      int level_index = stack[i].first;
-      int level_nsibs = stack[i].second;
-      if (level_index < level_nsibs) {
-        printf("|  ");
-      } else {
-        printf("   ");
-      }
+      unsigned i = top.next_kid++;
+      NodeRef kid = top.node->get_kid(i);
+      begin_node(path, kid, i == 0);
+      path.push_back({kid, 0, i + 1 == nkids});
     }
   }
 
+  if (m_tp->get_format() == TreePrint::JSON) {
+    m_out.put('\n');
+  }
+  m_out.flush();
+}
+
+// Write out a node; path holds its ancestors
+template<typename NodeRef>
+void TreePrintContext::begin_node(const std::vector<Frame<NodeRef>> &path, NodeRef n, bool is_first) {
   int tag = n->get_tag();
-  std::string str = n->get_str();
+  std::string str(n->get_str());
+  const Location &loc = n->get_loc();
+
+  switch (m_tp->get_format()) {
+  case TreePrint::TEXT:
+    for (size_t i = 1; i < path.size(); i++) {
+      m_out.put(path[i].is_last ? "   " : "|  ", 3);
+    }
+    if (!path.empty()) {
+      m_out.put("+--", 3);
+    }
+    m_out.put(tag_name(tag));
+    if (!str.empty()) {
+      m_out.put('[');
+      m_out.put(str);
+      m_out.put(']');
+    }
+    m_out.put('\n');
+    break;
 
-  printf("%s", tp_obj->node_tag_to_string(tag).c_str());
-  if (!str.empty()) {
-    printf("[%s]", str.c_str());
+  case TreePrint::JSON:
+    if (!path.empty()) {
+      m_out.put(is_first ? "\"kids\":[" : ",");
+    }
+    m_out.put("{\"tag\":");
+    put_json_str(tag_name(tag));
+    if (!str.empty()) {
+      m_out.put(",\"str\":");
+      put_json_str(str);
+    }
+    m_out.put(",\"line\":");
+    m_out.put_int(loc.get_line());
+    m_out.put(",\"col\":");
+    m_out.put_int(loc.get_col());
+    if (n->get_num_kids() > 0) {
+      m_out.put(',');
+    }
+    break;
+
+  case TreePrint::BINARY:
+    put_table_entry(m_tag_index, tag, tag_name(tag));
+    if (str.empty()) {
+      m_out.put_varint(0);
+    } else {
+      put_table_entry(m_str_index, str, str);
+    }
+    m_out.put_varint(n->get_num_kids());
+    m_out.put_signed(int64_t(loc.get_line()) - m_prev_line);
+    m_out.put_signed(int64_t(loc.get_col()) - m_prev_col);
+    m_prev_line = loc.get_line();
+    m_prev_col = loc.get_col();
+    break;
   }
-  printf("\n");
-  stack[depth-1].first++;
+}
 
-  int nkids = n->get_num_kids();
-  pushctx(nkids);
-  for (int i = 0; i < nkids; i++) {
-    print_node(n->get_kid(i));
+// Finish a node, once its kids have been written
+void TreePrintContext::end_node(unsigned nkids) {
+  if (m_tp->get_format() == TreePrint::JSON) {
+    m_out.put(nkids > 0 ? "]}" : "}");
+  }
+}
+
+const std::string &TreePrintContext::tag_name(int tag) {
+  auto i = m_tag_names.find(tag);
+  if (i == m_tag_names.end()) {
+    i = m_tag_names.insert({tag, m_tp->node_tag_to_string(tag)}).first;
+  }
+  return i->second;
+}
+
+void TreePrintContext::put_json_str(const std::string &s) {
+  m_out.put('"');
+  for (char c : s) {
+    switch (c) {
+    case '"':  m_out.put("\\\"", 2); break;
+    case '\\': m_out.put("\\\\", 2); break;
+    case '\n': m_out.put("\\n", 2); break;
+    case '\t': m_out.put("\\t", 2); break;
+    case '\r': m_out.put("\\r", 2); break;
+    default:
+      if (uint8_t(c) < 0x20) {
+        char tmp[8];
+        snprintf(tmp, sizeof(tmp), "\\u%04x", unsigned(uint8_t(c)));
+        m_out.put(tmp, 6);
+      } else {
+        m_out.put(c);
+      }
+    }
+  }
+  m_out.put('"');
+}
+
+// Write the index of key in a BINARY table, adding it (and writing
+// out value) if it's new
+template<typename Map, typename Key>
+void TreePrintContext::put_table_entry(Map &table, const Key &key, const std::string &value) {
+  auto i = table.insert({key, uint64_t(table.size() + 1)});
+  m_out.put_varint(i.first->second);
+  if (i.second) {
+    m_out.put_varint(value.size());
+    m_out.put(value);
   }
-  popctx();
 }
 
 } // end anonymous namespace
 
-TreePrint::TreePrint() {
+TreePrint::TreePrint()
+  : m_format(TEXT) {
 }
 
 TreePrint::~TreePrint() {
 }
 
-void TreePrint::print(Node *t) const {
-  TreePrintContext ctx(this);
-  ctx.pushctx(1);
-  ctx.print_node(t);
+void TreePrint::print(Node *t, FILE *out) const {
+  TreePrintContext ctx(this, out);
+  ctx.print_tree(t);
+}
+
+void TreePrint::print(const FlatAST &ast, FILE *out) const {
+  TreePrintContext ctx(this, out);
+  ctx.print_tree(ast.get_root());
 }
@@ -21,15 +21,47 @@
 #ifndef TREEPRINT_H
 #define TREEPRINT_H
 
+#include <cstdio>
 #include <string>
 struct Node;
+class FlatAST;
 
+// Writes out a tree, in one of these formats:
+//
+//   TEXT    an indented outline, one node per line
+//   JSON    each node is an object with "tag", "str" (if the node has
+//           a string), "line", "col" and "kids" (if it has any)
+//   BINARY  "MLAST01\n", then the nodes in preorder. All numbers are
+//           LEB128 varints. Each node is: the tag, the string, the
+//           number of kids, and then the line and the column, each
+//           as the zigzag-encoded change from the previous node. A tag
+//           or string is a 1-based index into a table that grows as
+//           the output is written: an index one past the end of the
+//           table is followed by a new entry (length and bytes).
+//           String index 0 means the node has no string.
+//
+// The tree is walked without recursion, and output is buffered, so
+// trees of any depth and size can be printed.
 class TreePrint {
+public:
+  enum Format {
+    TEXT,
+    JSON,
+    BINARY,
+  };
+
+private:
+  Format m_format;
+
 public:
   TreePrint();
   virtual ~TreePrint();
 
-  void print(Node *t) const;
+  void set_format(Format format) { m_format = format; }
+  Format get_format() const { return m_format; }
+
+  void print(Node *t, FILE *out = stdout) const;
+  void print(const FlatAST &ast, FILE *out = stdout) const;
 
   virtual std::string node_tag_to_string(int tag) const = 0;
 };
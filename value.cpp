@@ -6,11 +6,6 @@
 #include "string_literal.h"
 #include "value.h"
 
-Value::Value(int ival)
-        : m_kind(VALUE_INT) {
-    m_atomic.ival = ival;
-}
-
 Value::Value(Function *fn)
         : m_kind(VALUE_FUNCTION), m_rep(fn) {
     m_rep = fn;
@@ -32,15 +27,7 @@ Value::Value(String *st)
 }
 
 
-Value::Value(const Value &other)
-        : m_kind(VALUE_INT) {
-    // Just use the assignment operator to copy the other Value's data
-    *this = other;
-}
-
-Value::~Value() = default;
-
-Value &Value::operator=(const Value &rhs) {
+Value &Value::assign(const Value &rhs) {
     if (this != &rhs &&
         !(is_dynamic() && rhs.is_dynamic() && m_rep == rhs.m_rep)) {
         m_kind = rhs.m_kind;
@@ -57,7 +57,7 @@ private:
     };
 
 public:
-    Value(int ival = 0);
+    Value(int ival = 0) : m_kind(VALUE_INT) { m_atomic.ival = ival; }
 
     Value(Function *fn);
 
@@ -67,11 +67,19 @@ public:
 
     Value(IntrinsicFn intrinsic_fn);
 
-    Value(const Value &other);
+    Value(const Value &other) : m_kind(VALUE_INT) { *this = other; }
 
-    ~Value();
+    ~Value() = default;
 
-    Value &operator=(const Value &rhs);
+    Value &operator=(const Value &rhs) {
+        if (is_atomic() && rhs.is_atomic()) {
+            // no reference counts to update
+            m_kind = rhs.m_kind;
+            m_atomic = rhs.m_atomic;
+            return *this;
+        }
+        return assign(rhs);
+    }
 
     ValueKind get_kind() const { return m_kind; }
 
@@ -95,6 +103,17 @@ public:
         return m_atomic.intrinsic_fn;
     }
 
+    // Assign an int, skipping what operator= does for dynamic values
+    // when this isn't one.
+    void set_ival(int ival) {
+        if (is_dynamic()) {
+            *this = Value(ival);
+        } else {
+            m_kind = VALUE_INT;
+            m_atomic.ival = ival;
+        }
+    }
+
     // convert to a string representation
     std::string as_str() const;
 
@@ -105,6 +124,7 @@ public:
     bool is_atomic() const { return !is_dynamic(); }
 
 private:
+    Value &assign(const Value &rhs);
 };
 
 #endif // VALUE_H